@@ -0,0 +1,152 @@
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+
+#include "bf/compiler/ast.h"
+#include "bf/compiler/cell.h"
+#include "bf/compiler/optimizer.h"
+#include "bf/compiler/parser.h"
+#include "bf/interpreter/context.h"
+#include "bf/interpreter/interp_ast.h"
+#include "bf/interpreter/io.h"
+
+namespace dev::spiralgerbil::bf {
+namespace {
+
+const char* const Programs[] = {"hello_world", "stresstest", "mandelbrot"};
+
+using Pass = int (*)(ast::Tree*);
+
+// In the order Optimize() first runs them.
+const std::pair<const char*, Pass> Passes[] = {
+  {"RemoveImpossibleLoops", &RemoveImpossibleLoops},
+  {"FoldConstants", [](ast::Tree* tree) { return FoldConstants(tree, DefaultCellBits); }},
+  {"CollapseClearLoops", &CollapseClearLoops},
+  {"CollapseScanLoops", &CollapseScanLoops},
+  {"CollapseAddMulLoops",
+   [](ast::Tree* tree) { return CollapseAddMulLoops(tree, DefaultCellBits); }},
+  {"ConvertToOffsets", &ConvertToOffsets},
+  {"PropagateConstants",
+   [](ast::Tree* tree) { return PropagateConstants(tree, DefaultCellBits); }},
+  {"FuseOutputs", &FuseOutputs},
+};
+
+std::string LoadProgram(const std::string& name) {
+  return std::string(MappedFile("tests/" + name + ".bf").contents());
+}
+
+// `source` repeated `scale` times, for measuring how compile time grows with
+// program size.
+std::string ScaleProgram(const std::string& source, int scale) {
+  std::string scaled;
+  scaled.reserve(source.size() * scale);
+  for (int i = 0; i < scale; i++) {
+    scaled += source;
+  }
+  return scaled;
+}
+
+void BM_Parse(benchmark::State& state, const std::string& source) {
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(Parse(source));
+  }
+  state.SetBytesProcessed(state.iterations() * source.size());
+}
+
+void BM_Pass(benchmark::State& state, const std::string& source, int pass_index) {
+  for (auto _ : state) {
+    state.PauseTiming();
+    std::unique_ptr<ast::Tree> program = Parse(source);
+    for (int i = 0; i < pass_index; i++) {
+      Passes[i].second(program.get());
+    }
+    state.ResumeTiming();
+    Passes[pass_index].second(program.get());
+    state.PauseTiming();
+    program.reset();
+    state.ResumeTiming();
+  }
+}
+
+void BM_Optimize(benchmark::State& state, const std::string& source) {
+  for (auto _ : state) {
+    state.PauseTiming();
+    std::unique_ptr<ast::Tree> program = Parse(source);
+    state.ResumeTiming();
+    Optimize(program.get(), DefaultCellBits);
+    state.PauseTiming();
+    program.reset();
+    state.ResumeTiming();
+  }
+}
+
+void BM_InterpAst(benchmark::State& state, const std::string& source) {
+  std::unique_ptr<ast::Tree> program = Parse(source);
+  Optimize(program.get(), DefaultCellBits);
+  const int null_fd = open("/dev/null", O_WRONLY);
+  for (auto _ : state) {
+    OutputBuffer output(null_fd, FlushPolicy::Size);
+    InputBuffer input(std::string_view{});
+    Context<uint16_t> context(&output, &input);
+    InterpAst<uint16_t, EofBehavior::MinusOne>(*program, &context);
+  }
+  close(null_fd);
+}
+
+void RegisterCompileBenchmarks(const std::string& name, const std::string& source) {
+  benchmark::RegisterBenchmark(("BM_Parse/" + name).c_str(), BM_Parse, source);
+  for (int i = 0; i < static_cast<int>(std::size(Passes)); i++) {
+    benchmark::RegisterBenchmark(
+        ("BM_Pass/" + std::string(Passes[i].first) + "/" + name).c_str(), BM_Pass, source, i);
+  }
+  benchmark::RegisterBenchmark(("BM_Optimize/" + name).c_str(), BM_Optimize, source);
+}
+
+void RegisterBenchmarks() {
+  for (const char* name : Programs) {
+    const std::string source = LoadProgram(name);
+    RegisterCompileBenchmarks(name, source);
+    benchmark::RegisterBenchmark((std::string("BM_InterpAst/") + name).c_str(), BM_InterpAst,
+                                 source)
+        ->Unit(benchmark::kMillisecond);
+  }
+  // Synthetic large programs. Mandelbrot is the largest real program, so
+  // scaling it stands in for big generated sources.
+  const std::string mandelbrot = LoadProgram("mandelbrot");
+  for (int scale : {16, 256}) {
+    RegisterCompileBenchmarks("mandelbrot_x" + std::to_string(scale),
+                              ScaleProgram(mandelbrot, scale));
+  }
+}
+
+}  // namespace
+}  // namespace dev::spiralgerbil::bf
+
+int main(int argc, char* argv[]) {
+  // Report JSON by default so results can be stored and compared across
+  // versions.
+  std::vector<char*> args(argv, argv + argc);
+  bool format_given = false;
+  for (int i = 1; i < argc; i++) {
+    format_given |= std::strncmp(argv[i], "--benchmark_format", 18) == 0;
+  }
+  char json_format[] = "--benchmark_format=json";
+  if (!format_given) {
+    args.push_back(json_format);
+  }
+  int new_argc = args.size();
+  benchmark::Initialize(&new_argc, args.data());
+  if (benchmark::ReportUnrecognizedArguments(new_argc, args.data())) {
+    return 1;
+  }
+  dev::spiralgerbil::bf::RegisterBenchmarks();
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+}
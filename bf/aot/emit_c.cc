@@ -0,0 +1,140 @@
+#include "bf/aot/emit_c.h"
+
+#include <iomanip>
+#include <sstream>
+
+#include "bf/interpreter/tape.h"
+
+namespace dev::spiralgerbil::bf {
+namespace {
+
+constexpr int INDENT_INCREMENT = 2;
+
+class CEmitter : public NodeVisitor {
+ public:
+  using NodeVisitor::Visit;
+
+  CEmitter(int cell_bits, EofBehavior eof) : cell_bits_(cell_bits), eof_(eof) {}
+
+  NodeList::iterator Visit(ast::Move* node, NodeList::iterator iter) override {
+    Line() << "p += " << node->distance() << ";\n";
+    return iter;
+  }
+
+  NodeList::iterator Visit(ast::Add* node, NodeList::iterator iter) override {
+    Line() << "p[" << node->offset() << "] += " << node->amount() << ";\n";
+    return iter;
+  }
+
+  NodeList::iterator Visit(ast::Output* node, NodeList::iterator iter) override {
+    Line() << "putchar(p[" << node->offset() << "]);\n";
+    return iter;
+  }
+
+  NodeList::iterator Visit(ast::Input* node, NodeList::iterator iter) override {
+    switch (eof_) {
+      case EofBehavior::MinusOne:
+        Line() << "p[" << node->offset() << "] = getchar();\n";
+        break;
+      case EofBehavior::Zero:
+        Line() << "{ int c = getchar(); p[" << node->offset() << "] = c == EOF ? 0 : c; }\n";
+        break;
+      case EofBehavior::Unchanged:
+        Line() << "{ int c = getchar(); if (c != EOF) p[" << node->offset() << "] = c; }\n";
+        break;
+    }
+    return iter;
+  }
+
+  // Follows the hints of the profile-guided pass, like the JIT.
+  NodeList::iterator Visit(ast::Loop* node, NodeList::iterator iter) override {
+    const LoopHints& hints = node->hints();
+    if (hints.trip_count > 0) {
+      Line() << "if (p[" << node->offset() << "] == (cell)" << hints.entry_value << ") {\n";
+      indent_ += INDENT_INCREMENT;
+      for (int i = 0; i < hints.trip_count; i++) {
+        VisitChildren(node);
+      }
+      indent_ -= INDENT_INCREMENT;
+      Line() << "} else\n";
+    }
+    Line() << "while (p[" << node->offset() << "]) {\n";
+    indent_ += INDENT_INCREMENT;
+    for (int i = 0; i < hints.unroll; i++) {
+      if (i > 0) {
+        Line() << "if (!p[" << node->offset() << "]) break;\n";
+      }
+      VisitChildren(node);
+    }
+    indent_ -= INDENT_INCREMENT;
+    Line() << "}\n";
+    return iter;
+  }
+
+  NodeList::iterator Visit(ast::Set* node, NodeList::iterator iter) override {
+    Line() << "p[" << node->offset() << "] = " << node->value() << ";\n";
+    return iter;
+  }
+
+  NodeList::iterator Visit(ast::AddMul* node, NodeList::iterator iter) override {
+    // Unsigned arithmetic so that large products wrap instead of overflowing.
+    Line() << "p[" << node->offset() << "] += p[" << node->source() << "] * " << node->multiplier()
+           << "u;\n";
+    return iter;
+  }
+
+  NodeList::iterator Visit(ast::Write* node, NodeList::iterator iter) override {
+    Line() << "{\n";
+    Line() << "  const unsigned char out[] = {";
+    const char* separator = "";
+    for (int offset : node->offsets()) {
+      buffer_ << separator << "p[" << offset << "]";
+      separator = ", ";
+    }
+    buffer_ << "};\n";
+    Line() << "  fwrite(out, 1, sizeof(out), stdout);\n";
+    Line() << "}\n";
+    return iter;
+  }
+
+  NodeList::iterator Visit(ast::Scan* node, NodeList::iterator iter) override {
+    Line() << "while (p[0]) p += " << node->stride() << ";\n";
+    return iter;
+  }
+
+  std::string Emit(ast::Tree* program) {
+    buffer_ << "#include <stdint.h>\n"
+            << "#include <stdio.h>\n"
+            << "\n"
+            << "typedef uint" << cell_bits_ << "_t cell;\n"
+            << "\n"
+            << "static cell tape[" << Tape::DefaultCells << "];\n"
+            << "\n"
+            << "int main(void) {\n";
+    indent_ = INDENT_INCREMENT;
+    Line() << "cell* p = tape;\n";
+    Visit(program);
+    Line() << "return 0;\n";
+    buffer_ << "}\n";
+    return std::move(buffer_).str();
+  }
+
+ private:
+  const int cell_bits_;
+  const EofBehavior eof_;
+  std::stringstream buffer_;
+  int indent_ = 0;
+
+  std::stringstream& Line() {
+    buffer_ << std::setw(indent_) << "";
+    return buffer_;
+  }
+};
+
+}  // namespace
+
+std::string EmitC(ast::Tree* program, int cell_bits, EofBehavior eof) {
+  return CEmitter(cell_bits, eof).Emit(program);
+}
+
+}  // namespace dev::spiralgerbil::bf
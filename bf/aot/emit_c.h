@@ -0,0 +1,17 @@
+#ifndef DEV_SPIRALGERBIL_BF_AOT_EMIT_C_H_
+#define DEV_SPIRALGERBIL_BF_AOT_EMIT_C_H_
+
+#include <string>
+
+#include "bf/compiler/ast.h"
+#include "bf/compiler/cell.h"
+
+namespace dev::spiralgerbil::bf {
+
+// Translates an optimized program into a standalone C translation unit with
+// the same tape layout and I/O behaviour as the interpreters.
+std::string EmitC(ast::Tree* program, int cell_bits, EofBehavior eof);
+
+}  // namespace dev::spiralgerbil::bf
+
+#endif  // DEV_SPIRALGERBIL_BF_AOT_EMIT_C_H_
@@ -0,0 +1,171 @@
+#include "bf/batch/batch.h"
+
+#include <unistd.h>
+
+#include <cerrno>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "glog/logging.h"
+
+#include "bf/batch/work_stealing.h"
+#include "bf/interpreter/io.h"
+#include "bf/interpreter/tape.h"
+
+namespace dev::spiralgerbil::bf {
+namespace {
+
+// A program shared by all of the jobs that name it, compiled by whichever
+// of them gets to it first.
+struct SharedProgram {
+  std::string path;
+  std::once_flag compiled;
+  std::unique_ptr<const Program> program;
+  std::string error;
+};
+
+struct Result {
+  std::string output;
+  // Empty if the job finished.
+  std::string error;
+};
+
+// Results handed from the workers to the thread writing them out. Nothing
+// bounds how many it holds: a job that is slow to finish keeps the outputs of
+// every later job in memory until it is written.
+class Results {
+ public:
+  explicit Results(size_t count) : results_(count), done_(count) {}
+
+  void Put(size_t index, Result result) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    results_[index] = std::move(result);
+    done_[index] = true;
+    ready_.notify_one();
+  }
+
+  Result Take(size_t index) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    ready_.wait(lock, [&] { return done_[index]; });
+    return std::move(results_[index]);
+  }
+
+ private:
+  std::mutex mutex_;
+  std::condition_variable ready_;
+  std::vector<Result> results_;
+  std::vector<bool> done_;
+};
+
+void WriteAll(int fd, std::string_view data) {
+  while (!data.empty()) {
+    const ssize_t written = write(fd, data.data(), data.size());
+    if (written < 0 && errno == EINTR) {
+      continue;
+    }
+    PCHECK(written >= 0) << "Could not write output";
+    data.remove_prefix(written);
+  }
+}
+
+}  // namespace
+
+bool ParseBatch(std::string_view text, std::vector<BatchJob>* jobs, std::string* error) {
+  std::istringstream lines{std::string(text)};
+  std::string line;
+  for (int line_number = 1; std::getline(lines, line); line_number++) {
+    std::istringstream words(line);
+    std::vector<std::string> fields;
+    for (std::string field; words >> field;) {
+      fields.push_back(std::move(field));
+    }
+    if (fields.empty()) {
+      continue;
+    }
+    if (fields.size() > 2) {
+      *error = "Too many fields on line " + std::to_string(line_number);
+      return false;
+    }
+    jobs->push_back({fields[0], fields.size() > 1 ? fields[1] : ""});
+  }
+  return true;
+}
+
+size_t RunBatch(const std::vector<BatchJob>& jobs, const BatchOptions& options, int output_fd) {
+  absl::flat_hash_map<std::string_view, std::unique_ptr<SharedProgram>> programs;
+  std::vector<SharedProgram*> job_programs;
+  for (const BatchJob& job : jobs) {
+    std::unique_ptr<SharedProgram>& program = programs[job.program];
+    if (program == nullptr) {
+      program = std::make_unique<SharedProgram>();
+      program->path = job.program;
+    }
+    job_programs.push_back(program.get());
+  }
+
+  // Each worker reuses one tape for all of its jobs, instead of mapping and
+  // unmapping a fresh one for each.
+  std::vector<std::unique_ptr<Tape>> tapes(options.threads);
+  Results results(jobs.size());
+  auto run_job = [&](int worker, size_t index) {
+    SharedProgram* shared = job_programs[index];
+    std::call_once(shared->compiled, [&] {
+      if (const auto source = MappedFile::Open(shared->path, &shared->error)) {
+        shared->program = Program::Compile(source->contents(), options.program, &shared->error);
+      }
+    });
+    Result result;
+    if (shared->program == nullptr) {
+      result.error = shared->error;
+      results.Put(index, std::move(result));
+      return;
+    }
+    std::unique_ptr<MappedFile> input;
+    if (!jobs[index].input.empty()) {
+      input = MappedFile::Open(jobs[index].input, &result.error);
+      if (input == nullptr) {
+        results.Put(index, std::move(result));
+        return;
+      }
+    }
+    if (tapes[worker] == nullptr) {
+      tapes[worker] = std::make_unique<Tape>(options.tape_cells, options.program.cell_bits / 8);
+    }
+    ExecutionOptions execution_options;
+    execution_options.tape = tapes[worker].get();
+    execution_options.fuel = options.fuel;
+    Execution execution(shared->program.get(), input ? input->contents() : "", &result.output,
+                        execution_options);
+    const Execution::Status status = execution.Run();
+    if (status != Execution::Status::Finished) {
+      result.error = std::string(ExecutionStatusName(status));
+    }
+    results.Put(index, std::move(result));
+  };
+
+  size_t failures = 0;
+  std::thread writer([&] {
+    for (size_t index = 0; index < jobs.size(); index++) {
+      const Result result = results.Take(index);
+      WriteAll(output_fd, result.output);
+      if (!result.error.empty()) {
+        const BatchJob& job = jobs[index];
+        LOG(ERROR) << "Job " << index + 1 << " (" << job.program
+                   << (job.input.empty() ? "" : " < " + job.input) << "): " << result.error;
+        failures++;
+      }
+    }
+  });
+  ParallelFor(jobs.size(), options.threads, run_job);
+  writer.join();
+  return failures;
+}
+
+}  // namespace dev::spiralgerbil::bf
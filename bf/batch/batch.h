@@ -0,0 +1,43 @@
+#ifndef DEV_SPIRALGERBIL_BF_BATCH_BATCH_H_
+#define DEV_SPIRALGERBIL_BF_BATCH_BATCH_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "bf/embed/program.h"
+
+namespace dev::spiralgerbil::bf {
+
+struct BatchJob {
+  std::string program;
+  // Empty for no input.
+  std::string input;
+};
+
+// Parses one job per line, as the path of a BF program and optionally that of
+// its input, separated by whitespace. Blank lines are skipped. Returns false,
+// with the reason in `*error`, if a line has more than two fields.
+bool ParseBatch(std::string_view text, std::vector<BatchJob>* jobs, std::string* error);
+
+struct BatchOptions {
+  ProgramOptions program;
+  size_t tape_cells = Tape::DefaultCells;
+  // For each job.
+  uint64_t fuel = ExecutionOptions::Unlimited;
+  int threads = 1;
+};
+
+// Runs `jobs` in parallel, compiling each distinct program only once, and
+// writes their outputs to `output_fd` one after another in the order of the
+// jobs, as soon as all earlier ones are written. Until then, a job's output
+// is held in memory, however large it is. Jobs that do not finish, or whose
+// program or input cannot be read, are reported to stderr. Returns the number
+// of them.
+size_t RunBatch(const std::vector<BatchJob>& jobs, const BatchOptions& options, int output_fd);
+
+}  // namespace dev::spiralgerbil::bf
+
+#endif  // DEV_SPIRALGERBIL_BF_BATCH_BATCH_H_
@@ -0,0 +1,80 @@
+#include "bf/batch/work_stealing.h"
+
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace dev::spiralgerbil::bf {
+namespace {
+
+// The indices a thread has yet to run. The owner takes from the front and
+// thieves from the back, so they rarely want the same index. Tasks are whole
+// program runs, which dwarf the cost of the lock.
+struct Queue {
+  std::mutex mutex;
+  std::deque<size_t> indices;
+
+  bool PopFront(size_t* index) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (indices.empty()) {
+      return false;
+    }
+    *index = indices.front();
+    indices.pop_front();
+    return true;
+  }
+
+  bool PopBack(size_t* index) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (indices.empty()) {
+      return false;
+    }
+    *index = indices.back();
+    indices.pop_back();
+    return true;
+  }
+};
+
+}  // namespace
+
+void ParallelFor(size_t count, int threads, const std::function<void(int, size_t)>& task) {
+  std::vector<std::unique_ptr<Queue>> queues;
+  for (int worker = 0; worker < threads; worker++) {
+    queues.push_back(std::make_unique<Queue>());
+  }
+  for (size_t index = 0; index < count; index++) {
+    queues[index % threads]->indices.push_back(index);
+  }
+
+  auto work = [&](int worker) {
+    size_t index;
+    for (;;) {
+      if (queues[worker]->PopFront(&index)) {
+        task(worker, index);
+        continue;
+      }
+      // No task is ever added, so once every queue has been found empty
+      // there is nothing left to steal.
+      bool stolen = false;
+      for (int i = 1; i < threads && !stolen; i++) {
+        stolen = queues[(worker + i) % threads]->PopBack(&index);
+      }
+      if (!stolen) {
+        return;
+      }
+      task(worker, index);
+    }
+  };
+
+  std::vector<std::thread> pool;
+  for (int worker = 0; worker < threads; worker++) {
+    pool.emplace_back(work, worker);
+  }
+  for (std::thread& thread : pool) {
+    thread.join();
+  }
+}
+
+}  // namespace dev::spiralgerbil::bf
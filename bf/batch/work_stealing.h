@@ -0,0 +1,19 @@
+#ifndef DEV_SPIRALGERBIL_BF_BATCH_WORK_STEALING_H_
+#define DEV_SPIRALGERBIL_BF_BATCH_WORK_STEALING_H_
+
+#include <cstddef>
+#include <functional>
+
+namespace dev::spiralgerbil::bf {
+
+// Calls `task(worker, index)` for every index below `count` on `threads` new
+// threads, numbered from zero as `worker`, and returns once all calls have.
+// Indices are dealt out round robin, and each thread runs its own in
+// increasing order, so early indices finish first. A thread that runs out
+// steals the latest index of another, so uneven tasks still keep every
+// thread busy.
+void ParallelFor(size_t count, int threads, const std::function<void(int, size_t)>& task);
+
+}  // namespace dev::spiralgerbil::bf
+
+#endif  // DEV_SPIRALGERBIL_BF_BATCH_WORK_STEALING_H_
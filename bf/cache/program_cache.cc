@@ -0,0 +1,138 @@
+#include "bf/cache/program_cache.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <utility>
+
+#include "absl/strings/str_format.h"
+#include "glog/logging.h"
+
+#include "bf/compiler/fnv1a.h"
+#include "bf/compiler/serialize.h"
+#include "bf/interpreter/io.h"
+
+namespace dev::spiralgerbil::bf {
+namespace {
+
+// An entry is the header, the length of the full key and the Fnv1a hash of
+// the program as 8 bytes each, the full key itself, and then the program as
+// written by Serialize.
+std::string Header() { return absl::StrFormat("bf-cache %d\n", ProgramCache::Version); }
+
+std::string BinaryIdentity() {
+  struct stat info;
+  if (stat("/proc/self/exe", &info) != 0) {
+    return "unknown";
+  }
+  return absl::StrFormat("%d:%d:%d:%d.%09d", info.st_dev, info.st_ino, info.st_size,
+                         info.st_mtim.tv_sec, info.st_mtim.tv_nsec);
+}
+
+bool WriteAll(int fd, std::string_view data) {
+  while (!data.empty()) {
+    const ssize_t written = write(fd, data.data(), data.size());
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    data.remove_prefix(written);
+  }
+  return true;
+}
+
+}  // namespace
+
+ProgramCache::ProgramCache(std::string directory)
+    : directory_(std::move(directory)), binary_(BinaryIdentity()) {
+  if (mkdir(directory_.c_str(), 0777) != 0 && errno != EEXIST) {
+    PLOG(WARNING) << "Could not create cache directory " << directory_;
+  }
+}
+
+std::string ProgramCache::FullKey(std::string_view key) const {
+  std::string full_key = binary_;
+  full_key.push_back('\0');
+  full_key.append(key);
+  return full_key;
+}
+
+std::string ProgramCache::Path(std::string_view full_key) const {
+  Fnv1a hash;
+  hash.Add(full_key);
+  return absl::StrFormat("%s/%016x.bfc", directory_, hash.state());
+}
+
+std::unique_ptr<ast::Tree> ProgramCache::Lookup(std::string_view key) const {
+  const std::string full_key = FullKey(key);
+  const int fd = open(Path(full_key).c_str(), O_RDONLY);
+  if (fd < 0) {
+    return nullptr;
+  }
+  const MappedFile file(fd);
+  close(fd);
+  std::string_view entry = file.contents();
+  const std::string header = Header();
+  uint64_t key_size;
+  uint64_t program_hash;
+  if (entry.substr(0, header.size()) != header ||
+      entry.size() < header.size() + sizeof(key_size) + sizeof(program_hash)) {
+    return nullptr;
+  }
+  entry.remove_prefix(header.size());
+  std::memcpy(&key_size, entry.data(), sizeof(key_size));
+  entry.remove_prefix(sizeof(key_size));
+  std::memcpy(&program_hash, entry.data(), sizeof(program_hash));
+  entry.remove_prefix(sizeof(program_hash));
+  // Different keys may share a file name, so the whole key is compared.
+  if (key_size != full_key.size() || entry.substr(0, key_size) != full_key) {
+    return nullptr;
+  }
+  entry.remove_prefix(key_size);
+  // A damaged program could still parse, and then run wrongly.
+  Fnv1a hash;
+  hash.Add(entry);
+  FlatProgram program;
+  if (hash.state() != program_hash || !program.Parse(entry)) {
+    return nullptr;
+  }
+  return program.ToTree();
+}
+
+void ProgramCache::Store(std::string_view key, const ast::Tree& program, int cell_bits) const {
+  const std::string full_key = FullKey(key);
+  const uint64_t key_size = full_key.size();
+  const std::string data = Serialize(program, cell_bits);
+  Fnv1a hash;
+  hash.Add(data);
+  const uint64_t program_hash = hash.state();
+  std::string entry = Header();
+  entry.append(reinterpret_cast<const char*>(&key_size), sizeof(key_size));
+  entry.append(reinterpret_cast<const char*>(&program_hash), sizeof(program_hash));
+  entry.append(full_key);
+  entry.append(data);
+
+  const std::string path = Path(full_key);
+  std::string temp_path = path + ".XXXXXX";
+  const int fd = mkstemp(temp_path.data());
+  if (fd < 0) {
+    PLOG(WARNING) << "Could not create a cache entry in " << directory_;
+    return;
+  }
+  // mkstemp makes the file private, but the directory may be shared.
+  const bool written = fchmod(fd, 0644) == 0 && WriteAll(fd, entry);
+  if (close(fd) != 0 || !written || rename(temp_path.c_str(), path.c_str()) != 0) {
+    PLOG(WARNING) << "Could not write cache entry " << path;
+    unlink(temp_path.c_str());
+  }
+}
+
+}  // namespace dev::spiralgerbil::bf
@@ -0,0 +1,44 @@
+#ifndef DEV_SPIRALGERBIL_BF_CACHE_PROGRAM_CACHE_H_
+#define DEV_SPIRALGERBIL_BF_CACHE_PROGRAM_CACHE_H_
+
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include "bf/compiler/ast.h"
+
+namespace dev::spiralgerbil::bf {
+
+// Optimized programs saved in a directory that any number of processes may
+// share. Entries are written to a temporary file and renamed into place, so a
+// reader sees either a whole entry or none, and racing writers just replace
+// an entry with an identical one.
+class ProgramCache {
+ public:
+  static constexpr int Version = 2;
+
+  // Creates `directory` if it does not exist.
+  explicit ProgramCache(std::string directory);
+
+  // `key` must hold everything the optimized program depends on: the source
+  // and the options that change how it is optimized. The cache adds the
+  // identity of this binary itself. Returns null on a miss, which includes
+  // entries that are damaged or were written by another version.
+  std::unique_ptr<ast::Tree> Lookup(std::string_view key) const;
+  // Failures are logged and otherwise ignored, as the program can run
+  // without the cache.
+  void Store(std::string_view key, const ast::Tree& program, int cell_bits) const;
+
+ private:
+  const std::string directory_;
+  // The size, modification time and inode of the running binary, which
+  // change whenever it is rebuilt.
+  const std::string binary_;
+
+  std::string FullKey(std::string_view key) const;
+  std::string Path(std::string_view full_key) const;
+};
+
+}  // namespace dev::spiralgerbil::bf
+
+#endif  // DEV_SPIRALGERBIL_BF_CACHE_PROGRAM_CACHE_H_
@@ -0,0 +1,62 @@
+#include "bf/compiler/arena.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <new>
+
+namespace dev::spiralgerbil::bf {
+namespace {
+
+thread_local Arena* current_arena = nullptr;
+
+constexpr size_t HeaderSize = sizeof(Arena*);
+
+}  // namespace
+
+void* Arena::Allocate(size_t size, size_t alignment) {
+  uintptr_t start = (reinterpret_cast<uintptr_t>(pos_) + alignment - 1) & ~(alignment - 1);
+  if (pos_ == nullptr || start + size > reinterpret_cast<uintptr_t>(end_)) {
+    const size_t chunk_size = std::max(next_chunk_size_, size + alignment);
+    next_chunk_size_ = std::min(next_chunk_size_ * 2, MaxChunkSize);
+    chunks_.emplace_back(new char[chunk_size]);
+    bytes_reserved_ += chunk_size;
+    pos_ = chunks_.back().get();
+    end_ = pos_ + chunk_size;
+    start = (reinterpret_cast<uintptr_t>(pos_) + alignment - 1) & ~(alignment - 1);
+  }
+  pos_ = reinterpret_cast<char*>(start + size);
+  return reinterpret_cast<void*>(start);
+}
+
+Arena* Arena::current() {
+  return current_arena;
+}
+
+ArenaScope::ArenaScope(Arena* arena) : previous_(current_arena) {
+  current_arena = arena;
+}
+
+ArenaScope::~ArenaScope() {
+  current_arena = previous_;
+}
+
+void* ArenaNew(size_t size) {
+  Arena* arena = Arena::current();
+  char* block = arena != nullptr
+      ? static_cast<char*>(arena->Allocate(HeaderSize + size, HeaderSize))
+      : static_cast<char*>(::operator new(HeaderSize + size));
+  *reinterpret_cast<Arena**>(block) = arena;
+  return block + HeaderSize;
+}
+
+void ArenaDelete(void* ptr) {
+  if (ptr == nullptr) {
+    return;
+  }
+  char* block = static_cast<char*>(ptr) - HeaderSize;
+  if (*reinterpret_cast<Arena**>(block) == nullptr) {
+    ::operator delete(block);
+  }
+}
+
+}  // namespace dev::spiralgerbil::bf
@@ -0,0 +1,99 @@
+#ifndef DEV_SPIRALGERBIL_BF_COMPILER_ARENA_H_
+#define DEV_SPIRALGERBIL_BF_COMPILER_ARENA_H_
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+namespace dev::spiralgerbil::bf {
+
+// Bump allocator for AST storage. Individual allocations are never freed;
+// everything is released at once when the arena is destroyed.
+class Arena {
+ public:
+  Arena() = default;
+
+  Arena(const Arena&) = delete;
+  Arena& operator=(const Arena&) = delete;
+
+  void* Allocate(size_t size, size_t alignment);
+
+  // Total size of the chunks owned by the arena.
+  size_t bytes_reserved() const { return bytes_reserved_; }
+
+  // The arena that nodes and node lists created on this thread are allocated
+  // from, or null to use the heap.
+  static Arena* current();
+
+ private:
+  static constexpr size_t MinChunkSize = 64 * 1024;
+  static constexpr size_t MaxChunkSize = 4 * 1024 * 1024;
+
+  std::vector<std::unique_ptr<char[]>> chunks_;
+  char* pos_ = nullptr;
+  char* end_ = nullptr;
+  size_t next_chunk_size_ = MinChunkSize;
+  size_t bytes_reserved_ = 0;
+};
+
+// Makes `arena` the current arena for its lifetime. Scopes may nest.
+class ArenaScope {
+ public:
+  explicit ArenaScope(Arena* arena);
+  ~ArenaScope();
+
+  ArenaScope(const ArenaScope&) = delete;
+  ArenaScope& operator=(const ArenaScope&) = delete;
+
+ private:
+  Arena* const previous_;
+};
+
+// Allocates from the arena that was current when it was constructed, or from
+// the heap if there was none. Deallocation only frees heap memory.
+template <typename T>
+class ArenaAllocator {
+ public:
+  using value_type = T;
+  using propagate_on_container_move_assignment = std::true_type;
+  using propagate_on_container_swap = std::true_type;
+
+  ArenaAllocator() : arena_(Arena::current()) {}
+  explicit ArenaAllocator(Arena* arena) : arena_(arena) {}
+  template <typename U>
+  ArenaAllocator(const ArenaAllocator<U>& other) : arena_(other.arena()) {}
+
+  Arena* arena() const { return arena_; }
+
+  T* allocate(size_t n) {
+    if (arena_ == nullptr) {
+      return std::allocator<T>().allocate(n);
+    }
+    return static_cast<T*>(arena_->Allocate(n * sizeof(T), alignof(T)));
+  }
+
+  void deallocate(T* ptr, size_t n) {
+    if (arena_ == nullptr) {
+      std::allocator<T>().deallocate(ptr, n);
+    }
+  }
+
+  template <typename U>
+  bool operator==(const ArenaAllocator<U>& other) const { return arena_ == other.arena(); }
+  template <typename U>
+  bool operator!=(const ArenaAllocator<U>& other) const { return arena_ != other.arena(); }
+
+ private:
+  Arena* arena_;
+};
+
+// Backing for class-specific operator new/delete. Allocates from the current
+// arena, or from the heap if there is none, and remembers which in a
+// pointer-sized header so that ArenaDelete only frees heap memory. Objects
+// allocated this way must not need more than pointer alignment.
+void* ArenaNew(size_t size);
+void ArenaDelete(void* ptr);
+
+}  // namespace dev::spiralgerbil::bf
+
+#endif  // DEV_SPIRALGERBIL_BF_COMPILER_ARENA_H_
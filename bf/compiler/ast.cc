@@ -29,8 +29,12 @@ std::string Node::DebugString() const {
   return std::move(buffer).str();
 }
 
-NodeContainer::NodeContainer(NodeList children)
-    : Node(0) {
+NodeContainer::NodeContainer(NodeList children, int offset)
+    : Node(offset) {
+  ReplaceChildren(std::move(children));
+}
+
+void NodeContainer::ReplaceChildren(NodeList children) {
   for (auto& node : children) {
     CHECK(node.parent() == nullptr);
     node.set_parent(this);
@@ -51,6 +55,23 @@ Node* NodeContainer::Insert(NodeList::iterator before, std::unique_ptr<Node> nod
 }
 
 namespace ast {
+
+Tree::~Tree() {
+  if (arena_ != nullptr) {
+    // Everything below the tree lives in the arena, so there is nothing for
+    // the node destructors to free.
+    children().abandon();
+  }
+}
+
+void Tree::Reset(NodeList children, std::unique_ptr<Arena> arena) {
+  if (arena_ != nullptr) {
+    this->children().abandon();
+  }
+  ReplaceChildren(std::move(children));
+  arena_ = std::move(arena);
+}
+
 namespace {
 
 constexpr int INDENT_INCREMENT = 2;
@@ -95,7 +116,15 @@ void Input::DebugStringPart(std::stringstream* buffer, int indent) const {
 }
 
 void Loop::DebugStringPart(std::stringstream* buffer, int indent) const {
-  IndentPrint(buffer, indent, "Loop[\n");
+  IndentPrint(buffer, indent, "Loop ");
+  *buffer << offset();
+  if (hints_.unroll > 1) {
+    *buffer << " x" << hints_.unroll;
+  }
+  if (hints_.trip_count > 0) {
+    *buffer << " =" << hints_.entry_value << ":" << hints_.trip_count;
+  }
+  *buffer << "[\n";
   PrintSubnodes(buffer, indent, children());
   IndentPrint(buffer, indent, "]");
 }
@@ -107,7 +136,19 @@ void Set::DebugStringPart(std::stringstream* buffer, int indent) const {
 
 void AddMul::DebugStringPart(std::stringstream* buffer, int indent) const {
   IndentPrint(buffer, indent, "AddMul ");
-  *buffer << offset() << " x" << multiplier();
+  *buffer << offset() << " " << source() << " x" << multiplier();
+}
+
+void Write::DebugStringPart(std::stringstream* buffer, int indent) const {
+  IndentPrint(buffer, indent, "Write");
+  for (int offset : offsets()) {
+    *buffer << " " << offset;
+  }
+}
+
+void Scan::DebugStringPart(std::stringstream* buffer, int indent) const {
+  IndentPrint(buffer, indent, "Scan ");
+  *buffer << stride();
 }
 
 NodeList::iterator Tree::Accept(NodeVisitor* visitor, NodeList::iterator iter) {
@@ -122,6 +163,8 @@ NodeList::iterator Input::Accept(NodeVisitor* visitor, NodeList::iterator iter)
 NodeList::iterator Loop::Accept(NodeVisitor* visitor, NodeList::iterator iter) { return visitor->Visit(this, iter); }
 NodeList::iterator Set::Accept(NodeVisitor* visitor, NodeList::iterator iter) { return visitor->Visit(this, iter); }
 NodeList::iterator AddMul::Accept(NodeVisitor* visitor, NodeList::iterator iter) { return visitor->Visit(this, iter); }
+NodeList::iterator Write::Accept(NodeVisitor* visitor, NodeList::iterator iter) { return visitor->Visit(this, iter); }
+NodeList::iterator Scan::Accept(NodeVisitor* visitor, NodeList::iterator iter) { return visitor->Visit(this, iter); }
 
 }  // namespace ast
 
@@ -11,6 +11,7 @@
 
 #include "glog/logging.h"
 
+#include "bf/compiler/arena.h"
 #include "bf/compiler/poly_list.h"
 
 namespace dev::spiralgerbil::bf {
@@ -26,6 +27,30 @@ enum class NodeType {
   // Extensions
   Set,
   AddMul,
+  Write,
+  Scan,
+};
+
+// Where a node starts in the source, counting from 1. Zero if unknown.
+struct SourceLocation {
+  int line = 0;
+  int column = 0;
+};
+
+// What the profile-guided pass decided for a loop. The loop means the same
+// either way, so only the engines that generate code act on it.
+struct LoopHints {
+  // The most the profile-guided pass asks for.
+  static constexpr int MaxUnroll = 4;
+  static constexpr int MaxTripCount = 16;
+
+  // Copies of the body per trip around the loop, each but the last followed
+  // by a test of the loop's cell.
+  int unroll = 1;
+  // If nonzero, the loop usually starts with its cell equal to `entry_value`
+  // and then runs exactly `trip_count` times, with no tests at all.
+  int trip_count = 0;
+  int entry_value = 0;
 };
 
 class Node;
@@ -47,6 +72,12 @@ class Node {
 
   virtual ~Node() {}
 
+  // Nodes live in the current Arena, if there is one. Any storage they own
+  // must come from an ArenaAllocator as well, since a tree may be released
+  // without running destructors.
+  static void* operator new(size_t size) { return ArenaNew(size); }
+  static void operator delete(void* ptr) { ArenaDelete(ptr); }
+
   NodeContainer* parent() { return parent_; }
   const NodeContainer* parent() const { return parent_; }
   NodeList& siblings();
@@ -78,7 +109,7 @@ class Node {
 class NodeContainer : public Node {
  public:
   NodeContainer() : Node(0) {}
-  NodeContainer(NodeList children);
+  NodeContainer(NodeList children, int offset = 0);
 
   NodeList& children() { return children_; }
   const NodeList& children() const { return children_; }
@@ -93,6 +124,9 @@ class NodeContainer : public Node {
     return children().remove(node);
   }
 
+ protected:
+  void ReplaceChildren(NodeList children);
+
  private:
   NodeList children_;
 };
@@ -103,10 +137,28 @@ class Tree final : public NodeContainer {
  public:
   Tree() : NodeContainer() {}
   explicit Tree(NodeList children) : NodeContainer(std::move(children)) {}
+  // All of `children` must live in `arena`.
+  Tree(NodeList children, std::unique_ptr<Arena> arena)
+      : NodeContainer(std::move(children)), arena_(std::move(arena)) {}
+  ~Tree() override;
+
+  // Always on the heap, as a tree may own the arena its nodes live in.
+  static void* operator new(size_t size) { return ::operator new(size); }
+  static void operator delete(void* ptr) { ::operator delete(ptr); }
+
+  // The arena the nodes of this tree live in, or null if they are on the heap.
+  // Passes make it current while they create nodes.
+  Arena* arena() { return arena_.get(); }
+
+  // Replaces all children and the arena they live in, releasing the old ones.
+  void Reset(NodeList children, std::unique_ptr<Arena> arena);
 
   NodeType type() const { return NodeType::Tree; }
   void DebugStringPart(std::stringstream* buffer, int indent) const override;
   NodeList::iterator Accept(NodeVisitor* visitor, NodeList::iterator iter) override;
+
+ private:
+  std::unique_ptr<Arena> arena_;
 };
 
 class Move final : public Node {
@@ -156,14 +208,28 @@ class Input final : public Node {
   NodeList::iterator Accept(NodeVisitor* visitor, NodeList::iterator iter) override;
 };
 
+// Repeats its children while the cell at `offset` is non-zero. The children
+// address cells relative to the same pointer as the loop itself, so a loop
+// whose body returns the pointer to where it started needs no Moves at all.
 class Loop final : public NodeContainer {
  public:
   explicit Loop() : NodeContainer() {}
-  explicit Loop(NodeList children) : NodeContainer(std::move(children)) {}
+  explicit Loop(NodeList children, int offset = 0, SourceLocation location = {})
+      : NodeContainer(std::move(children), offset), location_(location) {}
+
+  // Where the [ of the loop is, for profiles.
+  SourceLocation location() const { return location_; }
+
+  const LoopHints& hints() const { return hints_; }
+  void set_hints(const LoopHints& hints) { hints_ = hints; }
 
   NodeType type() const { return NodeType::Loop; }
   void DebugStringPart(std::stringstream* buffer, int indent) const override;
   NodeList::iterator Accept(NodeVisitor* visitor, NodeList::iterator iter) override;
+
+ private:
+  const SourceLocation location_;
+  LoopHints hints_;
 };
 
 class Set final : public Node {
@@ -180,11 +246,14 @@ class Set final : public Node {
   const int value_;
 };
 
+// Adds the cell at `source` times `multiplier` to the cell at `offset`.
 class AddMul final : public Node {
  public:
-  explicit AddMul(int offset, int multiplier) : Node(offset), multiplier_(multiplier) {}
+  explicit AddMul(int offset, int multiplier, int source = 0)
+      : Node(offset), multiplier_(multiplier), source_(source) {}
 
   int multiplier() const { return multiplier_; }
+  int source() const { return source_; }
 
   NodeType type() const { return NodeType::AddMul; }
   void DebugStringPart(std::stringstream* buffer, int indent) const override;
@@ -192,6 +261,40 @@ class AddMul final : public Node {
 
  private:
   const int multiplier_;
+  const int source_;
+};
+
+// Outputs several cells in a row, in order.
+class Write final : public Node {
+ public:
+  using Offsets = std::vector<int, ArenaAllocator<int>>;
+
+  explicit Write(const std::vector<int>& offsets)
+      : Node(0), offsets_(offsets.begin(), offsets.end()) {}
+
+  const Offsets& offsets() const { return offsets_; }
+
+  NodeType type() const { return NodeType::Write; }
+  void DebugStringPart(std::stringstream* buffer, int indent) const override;
+  NodeList::iterator Accept(NodeVisitor* visitor, NodeList::iterator iter) override;
+
+ private:
+  const Offsets offsets_;
+};
+
+// Moves by `stride` until the current cell is zero.
+class Scan final : public Node {
+ public:
+  explicit Scan(int stride) : Node(0), stride_(stride) {}
+
+  int stride() const { return stride_; }
+
+  NodeType type() const { return NodeType::Scan; }
+  void DebugStringPart(std::stringstream* buffer, int indent) const override;
+  NodeList::iterator Accept(NodeVisitor* visitor, NodeList::iterator iter) override;
+
+ private:
+  const int stride_;
 };
 
 }  // namespace ast
@@ -206,6 +309,8 @@ class NodeVisitor {
   virtual NodeList::iterator Visit(ast::Loop* node, NodeList::iterator iter);
   virtual NodeList::iterator Visit(ast::Set* node, NodeList::iterator iter) { return iter; }
   virtual NodeList::iterator Visit(ast::AddMul* node, NodeList::iterator iter) { return iter; }
+  virtual NodeList::iterator Visit(ast::Write* node, NodeList::iterator iter) { return iter; }
+  virtual NodeList::iterator Visit(ast::Scan* node, NodeList::iterator iter) { return iter; }
 
  protected:
   void VisitChildren(NodeContainer* node);
@@ -0,0 +1,192 @@
+#include "bf/compiler/bytecode.h"
+
+#include <sstream>
+#include <utility>
+#include <vector>
+
+#include "glog/logging.h"
+
+#include "bf/compiler/fnv1a.h"
+
+namespace dev::spiralgerbil::bf {
+namespace {
+
+using bytecode::Instruction;
+using bytecode::OpCode;
+
+void Lower_rec(const NodeContainer& container, Bytecode* output) {
+  for (const auto& node : container.children()) {
+    const int32_t offset = node.offset();
+    switch (node.type()) {
+      case NodeType::Move:
+        output->push_back({OpCode::Move, 0, static_cast<const ast::Move&>(node).distance()});
+        break;
+      case NodeType::Add:
+        output->push_back({OpCode::Add, offset, static_cast<const ast::Add&>(node).amount()});
+        break;
+      case NodeType::Output:
+        output->push_back({OpCode::Output, offset, 0});
+        break;
+      case NodeType::Input:
+        output->push_back({OpCode::Input, offset, 0});
+        break;
+      case NodeType::Loop: {
+        const int32_t begin = output->size();
+        output->push_back({OpCode::LoopBegin, offset, 0});
+        Lower_rec(static_cast<const ast::Loop&>(node), output);
+        const int32_t end = output->size();
+        output->push_back({OpCode::LoopEnd, offset, begin});
+        (*output)[begin].arg = end;
+        break;
+      }
+      case NodeType::Set:
+        output->push_back({OpCode::Set, offset, static_cast<const ast::Set&>(node).value()});
+        break;
+      case NodeType::AddMul: {
+        const auto& addmul = static_cast<const ast::AddMul&>(node);
+        output->push_back({OpCode::AddMul, offset, addmul.multiplier()});
+        output->push_back({OpCode::AddMul, addmul.source(), 0});
+        break;
+      }
+      case NodeType::Write: {
+        const auto& offsets = static_cast<const ast::Write&>(node).offsets();
+        output->push_back({OpCode::Write, 0, static_cast<int32_t>(offsets.size())});
+        for (int write_offset : offsets) {
+          output->push_back({OpCode::Write, write_offset, 0});
+        }
+        break;
+      }
+      case NodeType::Scan:
+        output->push_back({OpCode::Scan, 0, static_cast<const ast::Scan&>(node).stride()});
+        break;
+      default:
+        LOG(FATAL) << "Cannot lower node: " << node.DebugString();
+    }
+  }
+}
+
+}  // namespace
+
+Bytecode LowerToBytecode(const ast::Tree& program) {
+  Bytecode output;
+  Lower_rec(program, &output);
+  output.push_back({OpCode::Halt, 0, 0});
+  return output;
+}
+
+Bytecode LowerToBytecode(const FlatProgram& program) {
+  Bytecode output;
+  // The record each open loop ends before, and the index of its LoopBegin.
+  std::vector<std::pair<size_t, int32_t>> loops;
+  for (size_t i = 0;;) {
+    while (!loops.empty() && loops.back().first == i) {
+      const int32_t begin = loops.back().second;
+      const int32_t end = output.size();
+      output.push_back({OpCode::LoopEnd, output[begin].offset, begin});
+      output[begin].arg = end;
+      loops.pop_back();
+    }
+    if (i == program.size()) {
+      break;
+    }
+    const FlatRecord record = program.record(i);
+    const size_t slots = FlatProgram::Slots(record);
+    switch (static_cast<NodeType>(record.type)) {
+      case NodeType::Move:
+        output.push_back({OpCode::Move, 0, record.operand});
+        break;
+      case NodeType::Add:
+        output.push_back({OpCode::Add, record.offset, record.operand});
+        break;
+      case NodeType::Output:
+        output.push_back({OpCode::Output, record.offset, 0});
+        break;
+      case NodeType::Input:
+        output.push_back({OpCode::Input, record.offset, 0});
+        break;
+      case NodeType::Loop:
+        loops.emplace_back(i + slots + record.operand, output.size());
+        output.push_back({OpCode::LoopBegin, record.offset, 0});
+        break;
+      case NodeType::Set:
+        output.push_back({OpCode::Set, record.offset, record.operand});
+        break;
+      case NodeType::AddMul:
+        output.push_back({OpCode::AddMul, record.offset, record.operand});
+        output.push_back({OpCode::AddMul, program.record(i + 1).offset, 0});
+        break;
+      case NodeType::Write:
+        output.push_back({OpCode::Write, 0, record.operand});
+        for (size_t slot = 1; slot < slots; slot++) {
+          output.push_back({OpCode::Write, program.record(i + slot).offset, 0});
+        }
+        break;
+      case NodeType::Scan:
+        output.push_back({OpCode::Scan, 0, record.operand});
+        break;
+      default:
+        LOG(FATAL) << "Cannot lower record of type " << record.type;
+    }
+    i += slots;
+  }
+  output.push_back({OpCode::Halt, 0, 0});
+  return output;
+}
+
+uint64_t HashBytecode(const Bytecode& program) {
+  Fnv1a hash;
+  for (const Instruction& inst : program) {
+    hash.Add(static_cast<int>(inst.op));
+    hash.Add(inst.offset);
+    hash.Add(inst.arg);
+  }
+  return hash.state();
+}
+
+int InstructionSlots(const Instruction& inst) {
+  switch (inst.op) {
+    case OpCode::AddMul:
+      return 2;
+    case OpCode::Write:
+      return inst.arg + 1;
+    default:
+      return 1;
+  }
+}
+
+const char* OpCodeName(OpCode op) {
+  switch (op) {
+    case OpCode::Move: return "Move";
+    case OpCode::Add: return "Add";
+    case OpCode::Output: return "Output";
+    case OpCode::Input: return "Input";
+    case OpCode::LoopBegin: return "LoopBegin";
+    case OpCode::LoopEnd: return "LoopEnd";
+    case OpCode::Set: return "Set";
+    case OpCode::AddMul: return "AddMul";
+    case OpCode::Write: return "Write";
+    case OpCode::Scan: return "Scan";
+    case OpCode::Halt: return "Halt";
+  }
+  return "???";
+}
+
+std::string BytecodeDebugString(const Bytecode& program) {
+  std::stringstream buffer;
+  for (size_t i = 0; i < program.size(); i++) {
+    const Instruction& inst = program[i];
+    buffer << i << ": " << OpCodeName(inst.op) << " " << inst.offset << " " << inst.arg << "\n";
+    if (inst.op == OpCode::Write) {
+      for (int32_t j = 1; j <= inst.arg; j++) {
+        buffer << i + j << ":   " << program[i + j].offset << "\n";
+      }
+      i += inst.arg;
+    } else if (inst.op == OpCode::AddMul) {
+      i++;
+      buffer << i << ":   " << program[i].offset << "\n";
+    }
+  }
+  return std::move(buffer).str();
+}
+
+}  // namespace dev::spiralgerbil::bf
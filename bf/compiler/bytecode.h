@@ -0,0 +1,68 @@
+#ifndef DEV_SPIRALGERBIL_BF_COMPILER_BYTECODE_H_
+#define DEV_SPIRALGERBIL_BF_COMPILER_BYTECODE_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "bf/compiler/ast.h"
+#include "bf/compiler/serialize.h"
+
+namespace dev::spiralgerbil::bf {
+namespace bytecode {
+
+enum class OpCode : uint8_t {
+  Move,
+  Add,
+  Output,
+  Input,
+  // Jumps to the instruction after the matching LoopEnd if the cell at
+  // `offset` is zero.
+  LoopBegin,
+  // Jumps to the instruction after the matching LoopBegin if the cell at
+  // `offset` is non-zero.
+  LoopEnd,
+  Set,
+  // Adds the source cell times `arg` to the cell at `offset`. It is followed
+  // by one operand slot, whose `offset` is that of the source cell.
+  AddMul,
+  // Outputs `arg` cells. It is followed by `arg` operand slots, which only
+  // carry the offsets of the cells to output and are skipped over.
+  Write,
+  // Moves by `arg` until the current cell is zero.
+  Scan,
+  Halt,
+};
+
+// A single flat instruction. `arg` is the distance, amount, value or
+// multiplier of the corresponding AST node, or the index of the partner
+// instruction for loops.
+struct Instruction {
+  OpCode op;
+  int32_t offset;
+  int32_t arg;
+};
+
+}  // namespace bytecode
+
+// A contiguous instruction stream, always terminated by a Halt instruction.
+using Bytecode = std::vector<bytecode::Instruction>;
+
+Bytecode LowerToBytecode(const ast::Tree& program);
+// Lowers the records in place, without building a tree.
+Bytecode LowerToBytecode(const FlatProgram& program);
+
+// The same for the same instructions in every process, so that state saved
+// from one run can be checked against the program of another.
+uint64_t HashBytecode(const Bytecode& program);
+
+// Number of slots taken by `inst` and the operand slots that follow it.
+int InstructionSlots(const bytecode::Instruction& inst);
+
+const char* OpCodeName(bytecode::OpCode op);
+
+std::string BytecodeDebugString(const Bytecode& program);
+
+}  // namespace dev::spiralgerbil::bf
+
+#endif  // DEV_SPIRALGERBIL_BF_COMPILER_BYTECODE_H_
@@ -0,0 +1,109 @@
+#ifndef DEV_SPIRALGERBIL_BF_COMPILER_CELL_H_
+#define DEV_SPIRALGERBIL_BF_COMPILER_CELL_H_
+
+#include <cstdint>
+#include <string_view>
+#include <type_traits>
+
+#include "glog/logging.h"
+
+namespace dev::spiralgerbil::bf {
+
+// What Input stores in the cell once the input is exhausted.
+enum class EofBehavior {
+  MinusOne,   // All bits set, like C's EOF.
+  Zero,
+  Unchanged,  // Leave the cell as it was.
+};
+
+constexpr int DefaultCellBits = 16;
+
+// How far from the pointer, in bytes, one offset or move may reach. The tape
+// is surrounded by guard regions this large, so that such an access from a
+// cell of the tape faults instead of landing in other memory.
+constexpr int64_t MaxReachBytes = int64_t{256} << 20;
+
+inline bool IsValidCellBits(int bits) {
+  return bits == 8 || bits == 16 || bits == 32;
+}
+
+inline bool ParseEofBehavior(std::string_view name, EofBehavior* eof) {
+  if (name == "minus_one") {
+    *eof = EofBehavior::MinusOne;
+  } else if (name == "zero") {
+    *eof = EofBehavior::Zero;
+  } else if (name == "unchanged") {
+    *eof = EofBehavior::Unchanged;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+// The representative of `value` modulo 2^bits in [-2^(bits-1), 2^(bits-1)),
+// which is what the optimizer folds constants to.
+inline int32_t WrapToCell(int64_t value, int bits) {
+  const uint64_t mask = (uint64_t{1} << bits) - 1;
+  const uint64_t sign = uint64_t{1} << (bits - 1);
+  return static_cast<int32_t>(static_cast<int64_t>(((static_cast<uint64_t>(value) & mask) ^ sign)) -
+                              static_cast<int64_t>(sign));
+}
+
+// Calls `f(CellType<Cell>{}, EofType<Eof>{})` with the cell type and EOF
+// behavior chosen at runtime, so that engines can be instantiated for each of
+// them instead of branching on every operation.
+template <typename T>
+struct CellType {
+  using type = T;
+};
+
+template <EofBehavior E>
+using EofType = std::integral_constant<EofBehavior, E>;
+
+template <typename Cell, typename F>
+decltype(auto) DispatchEof(EofBehavior eof, F&& f) {
+  switch (eof) {
+    case EofBehavior::MinusOne:
+      return f(CellType<Cell>{}, EofType<EofBehavior::MinusOne>{});
+    case EofBehavior::Zero:
+      return f(CellType<Cell>{}, EofType<EofBehavior::Zero>{});
+    case EofBehavior::Unchanged:
+      return f(CellType<Cell>{}, EofType<EofBehavior::Unchanged>{});
+  }
+  LOG(FATAL) << "Unknown EOF behavior";
+}
+
+template <typename F>
+decltype(auto) DispatchCell(int bits, EofBehavior eof, F&& f) {
+  switch (bits) {
+    case 8:
+      return DispatchEof<uint8_t>(eof, f);
+    case 16:
+      return DispatchEof<uint16_t>(eof, f);
+    case 32:
+      return DispatchEof<uint32_t>(eof, f);
+  }
+  LOG(FATAL) << "Unsupported cell width: " << bits;
+}
+
+// Expands X(Cell) or X(Cell, Eof) for every supported combination, for
+// explicitly instantiating the engines.
+#define BF_FOR_EACH_CELL_TYPE(X)      \
+  X(uint8_t)                          \
+  X(uint16_t)                         \
+  X(uint32_t)
+
+#define BF_FOR_EACH_CELL_CONFIG(X)    \
+  X(uint8_t, EofBehavior::MinusOne)   \
+  X(uint8_t, EofBehavior::Zero)       \
+  X(uint8_t, EofBehavior::Unchanged)  \
+  X(uint16_t, EofBehavior::MinusOne)  \
+  X(uint16_t, EofBehavior::Zero)      \
+  X(uint16_t, EofBehavior::Unchanged) \
+  X(uint32_t, EofBehavior::MinusOne)  \
+  X(uint32_t, EofBehavior::Zero)      \
+  X(uint32_t, EofBehavior::Unchanged)
+
+}  // namespace dev::spiralgerbil::bf
+
+#endif  // DEV_SPIRALGERBIL_BF_COMPILER_CELL_H_
@@ -0,0 +1,35 @@
+#ifndef DEV_SPIRALGERBIL_BF_COMPILER_FNV1A_H_
+#define DEV_SPIRALGERBIL_BF_COMPILER_FNV1A_H_
+
+#include <cstdint>
+#include <string_view>
+
+namespace dev::spiralgerbil::bf {
+
+// 64-bit FNV-1a, which unlike absl::Hash is the same in every process, for
+// keys that are saved to files.
+class Fnv1a {
+ public:
+  void Add(int64_t value) {
+    for (int i = 0; i < 8; i++) {
+      AddByte(static_cast<uint8_t>(value >> (8 * i)));
+    }
+  }
+
+  void Add(std::string_view bytes) {
+    for (char byte : bytes) {
+      AddByte(static_cast<uint8_t>(byte));
+    }
+  }
+
+  uint64_t state() const { return state_; }
+
+ private:
+  uint64_t state_ = 0xcbf29ce484222325;
+
+  void AddByte(uint8_t byte) { state_ = (state_ ^ byte) * 0x100000001b3; }
+};
+
+}  // namespace dev::spiralgerbil::bf
+
+#endif  // DEV_SPIRALGERBIL_BF_COMPILER_FNV1A_H_
@@ -1,151 +1,486 @@
 #include "bf/compiler/optimizer.h"
 
-#include "absl/container/flat_hash_map.h"
+#include <cstdint>
+#include <iterator>
+#include <map>
+#include <set>
+#include <utility>
+#include <vector>
 
 #include "glog/logging.h"
 
+#include "bf/compiler/cell.h"
+
 namespace dev::spiralgerbil::bf {
 
-void Optimize(ast::Tree* program) {
-  RemoveImpossibleLoops(program);
-  CollapseClearLoops(program);
-  CollapseAddMulLoops(program);
-  ConvertToOffsets(program);
+void AddDefaultPasses(PassManager* pass_manager, int cell_bits, const SavedProfile* profile,
+                      int64_t partial_eval_budget) {
+  pass_manager->AddPass("RemoveImpossibleLoops", &RemoveImpossibleLoops);
+  pass_manager->AddPass("FoldConstants",
+                        [cell_bits](ast::Tree* tree) { return FoldConstants(tree, cell_bits); });
+  pass_manager->AddPass("CollapseClearLoops", &CollapseClearLoops);
+  pass_manager->AddPass("CollapseScanLoops", &CollapseScanLoops);
+  pass_manager->AddPass("CollapseAddMulLoops", [cell_bits](ast::Tree* tree) {
+    return CollapseAddMulLoops(tree, cell_bits);
+  });
+  // Offsets are relative to the Moves being removed, so this can only run once.
+  pass_manager->AddFinalPass("ConvertToOffsets", &ConvertToOffsets);
+  pass_manager->AddFinalPass("PropagateConstants", [cell_bits](ast::Tree* tree) {
+    return PropagateConstants(tree, cell_bits);
+  });
+  pass_manager->AddFinalPass("FuseOutputs", &FuseOutputs);
+  if (partial_eval_budget > 0) {
+    pass_manager->AddFinalPass("PartiallyEvaluate",
+                               [cell_bits, partial_eval_budget](ast::Tree* tree) {
+                                 return PartiallyEvaluate(tree, cell_bits, partial_eval_budget);
+                               });
+  }
+  if (profile != nullptr) {
+    pass_manager->AddFinalPass("ApplyProfile", [profile, cell_bits](ast::Tree* tree) {
+      return ApplyProfile(tree, *profile, cell_bits);
+    });
+  }
+}
+
+void Optimize(ast::Tree* program, int cell_bits) {
+  PassManager pass_manager;
+  AddDefaultPasses(&pass_manager, cell_bits);
+  pass_manager.Run(program);
 }
 
-void RemoveImpossibleLoops(ast::Tree* tree) {
+int RemoveImpossibleLoops(ast::Tree* tree) {
+  ArenaScope scope(tree->arena());
   auto& children = tree->children();
   auto iter = children.begin();
   for (auto end = children.end(); iter != end && iter->type() == NodeType::Loop; ++iter);
+  int rewrites = iter - children.begin();
   children.erase(children.begin(), iter);
 
-  class : public NodeVisitor {
+  class LoopVisitor : public NodeVisitor {
    public:
     using NodeVisitor::Visit;
     NodeList::iterator Visit(ast::Loop* node, NodeList::iterator iter) {
-      if (node->children().empty()) {
-        return node->siblings().erase(iter) - 1;
-      } else if (!node->first() && (iter-1)->type() == NodeType::Loop) {
+      if (node->children().empty() || (!node->first() && LeavesCellZero(*(iter - 1)))) {
+        rewrites++;
         return node->siblings().erase(iter) - 1;
       }
       VisitChildren(node);
       return iter;
     }
+
+    int rewrites = 0;
+
+   private:
+    // Whether the current cell is known to be zero after `node` runs.
+    static bool LeavesCellZero(const Node& node) {
+      switch (node.type()) {
+        case NodeType::Loop:
+        case NodeType::Scan:
+          return true;
+        case NodeType::Set:
+          return node.offset() == 0 && static_cast<const ast::Set&>(node).value() == 0;
+        default:
+          return false;
+      }
+    }
   } visitor;
   visitor.Visit(tree);
+  return rewrites + visitor.rewrites;
+}
+
+int FoldConstants(ast::Tree* tree, int cell_bits) {
+  ArenaScope scope(tree->arena());
+  class ConstantVisitor : public NodeVisitor {
+   public:
+    using NodeVisitor::Visit;
+
+    explicit ConstantVisitor(int cell_bits) : cell_bits_(cell_bits) {}
+
+    NodeList::iterator Visit(ast::Add* node, NodeList::iterator iter) override {
+      const int amount = WrapToCell(node->amount(), cell_bits_);
+      if (amount == 0) {
+        rewrites++;
+        return node->siblings().erase(iter) - 1;
+      } else if (amount != node->amount()) {
+        rewrites++;
+        iter.replace<ast::Add>(amount, node->offset());
+      }
+      return iter;
+    }
+
+    NodeList::iterator Visit(ast::Set* node, NodeList::iterator iter) override {
+      const int value = WrapToCell(node->value(), cell_bits_);
+      if (value != node->value()) {
+        rewrites++;
+        iter.replace<ast::Set>(value, node->offset());
+      }
+      return iter;
+    }
+
+    NodeList::iterator Visit(ast::AddMul* node, NodeList::iterator iter) override {
+      const int multiplier = WrapToCell(node->multiplier(), cell_bits_);
+      if (multiplier == 0) {
+        rewrites++;
+        return node->siblings().erase(iter) - 1;
+      } else if (multiplier != node->multiplier()) {
+        rewrites++;
+        iter.replace<ast::AddMul>(node->offset(), multiplier, node->source());
+      }
+      return iter;
+    }
+
+    int rewrites = 0;
+
+   private:
+    const int cell_bits_;
+  } visitor(cell_bits);
+  visitor.Visit(tree);
+  return visitor.rewrites;
 }
 
-void CollapseClearLoops(ast::Tree* tree) {
-  class : public NodeVisitor {
+int CollapseClearLoops(ast::Tree* tree) {
+  ArenaScope scope(tree->arena());
+  class ClearVisitor : public NodeVisitor {
    public:
     using NodeVisitor::Visit;
     NodeList::iterator Visit(ast::Loop* node, NodeList::iterator iter) override {
       auto& children = node->children();
-      if (children.size() == 1 && children[0].type() == NodeType::Add) {
+      // Stepping by an odd amount reaches zero from any value, as the cell
+      // width is a power of two. Even steps can loop forever.
+      if (children.size() == 1 && children[0].type() == NodeType::Add &&
+          static_cast<const ast::Add&>(children[0]).amount() % 2 != 0) {
+        rewrites++;
         iter.replace<ast::Set>(0);
       } else {
         VisitChildren(node);
       }
       return iter;
     }
+
+    int rewrites = 0;
   } visitor;
   visitor.Visit(tree);
+  return visitor.rewrites;
 }
 
-void CollapseAddMulLoops(ast::Tree* tree) {
-  class : public NodeVisitor {
+int CollapseScanLoops(ast::Tree* tree) {
+  ArenaScope scope(tree->arena());
+  class ScanVisitor : public NodeVisitor {
    public:
     using NodeVisitor::Visit;
-
     NodeList::iterator Visit(ast::Loop* node, NodeList::iterator iter) override {
-      if (AttemptReplace(node, iter)) {
+      auto& children = node->children();
+      if (children.size() == 1 && children[0].type() == NodeType::Move) {
+        rewrites++;
+        iter.replace<ast::Scan>(static_cast<const ast::Move&>(children[0]).distance());
+      } else {
         VisitChildren(node);
       }
       return iter;
     }
 
-   private:
-    bool AttemptReplace(ast::Loop* node, NodeList::iterator iter) {
-      auto& children = node->children();
-      if (children.empty()) {
-        return false;
+    int rewrites = 0;
+  } visitor;
+  visitor.Visit(tree);
+  return visitor.rewrites;
+}
+
+namespace {
+
+// A cell's value after running a loop body once, as an affine function of the
+// cell values before it, computed modulo 2^64 and reduced to the cell width
+// only when compared or emitted.
+struct Affine {
+  uint64_t constant = 0;
+  // Coefficient of each cell's initial value, keyed by offset.
+  std::map<int, uint64_t> coefficients;
+
+  static Affine Identity(int offset) {
+    Affine affine;
+    affine.coefficients[offset] = 1;
+    return affine;
+  }
+
+  void AddScaled(const Affine& other, uint64_t scale) {
+    constant += other.constant * scale;
+    for (const auto& [offset, coefficient] : other.coefficients) {
+      coefficients[offset] += coefficient * scale;
+    }
+  }
+
+  void Reduce(int cell_bits) {
+    const uint64_t mask = cell_bits == 64 ? ~uint64_t{0} : (uint64_t{1} << cell_bits) - 1;
+    constant &= mask;
+    for (auto iter = coefficients.begin(); iter != coefficients.end();) {
+      iter->second &= mask;
+      iter = iter->second == 0 ? coefficients.erase(iter) : std::next(iter);
+    }
+  }
+};
+
+// Inverse of an odd `value` modulo 2^64, by Newton's iteration. Each step
+// doubles the number of correct low bits, starting from 3.
+uint64_t InverseOdd(uint64_t value) {
+  uint64_t inverse = value;
+  for (int i = 0; i < 5; i++) {
+    inverse *= 2 - value * inverse;
+  }
+  return inverse;
+}
+
+// Whether `loop` is the output of CollapseAddMulLoops with no peeled body:
+// AddMuls from the loop's cell followed by clearing it. Such a loop does
+// nothing when the cell is zero, so it can be treated as unconditional.
+bool IsCollapsedAddMul(const ast::Loop& loop) {
+  const auto& children = loop.children();
+  if (children.empty() || children.back().type() != NodeType::Set ||
+      children.back().offset() != loop.offset() ||
+      static_cast<const ast::Set&>(children.back()).value() != 0) {
+    return false;
+  }
+  for (size_t i = 0; i + 1 < children.size(); i++) {
+    if (children[i].type() != NodeType::AddMul ||
+        static_cast<const ast::AddMul&>(children[i]).source() != loop.offset()) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Symbolically runs one iteration of `loop`, returning false if its body is
+// not a balanced sequence of affine updates.
+bool RunLoopBody(const ast::Loop& loop, std::map<int, Affine>* cells) {
+  auto cell = [cells](int offset) -> Affine& {
+    auto [iter, inserted] = cells->try_emplace(offset);
+    if (inserted) {
+      iter->second = Affine::Identity(offset);
+    }
+    return iter->second;
+  };
+  int position = 0;
+  for (const Node& child : loop.children()) {
+    const int offset = position + child.offset();
+    switch (child.type()) {
+      case NodeType::Move:
+        position += static_cast<const ast::Move&>(child).distance();
+        break;
+      case NodeType::Add:
+        cell(offset).constant += static_cast<const ast::Add&>(child).amount();
+        break;
+      case NodeType::Set:
+        cell(offset) = Affine();
+        cell(offset).constant = static_cast<const ast::Set&>(child).value();
+        break;
+      case NodeType::AddMul: {
+        const auto& addmul = static_cast<const ast::AddMul&>(child);
+        const Affine source = cell(position + addmul.source());
+        cell(offset).AddScaled(source, addmul.multiplier());
+        break;
       }
-      int net_offset = 0;
-      absl::flat_hash_map<int, int> multipliers;
-      for (const Node& child : children) {
-        switch (child.type()) {
-          case NodeType::Move:
-            net_offset += static_cast<const ast::Move&>(child).distance();
-            break;
-          case NodeType::Add:
-            multipliers[net_offset] += static_cast<const ast::Add&>(child).amount();
-            break;
-          default:
-            return true;
+      case NodeType::Loop: {
+        const auto& inner = static_cast<const ast::Loop&>(child);
+        if (!IsCollapsedAddMul(inner)) {
+          return false;
+        }
+        for (const Node& update : inner.children()) {
+          if (update.type() == NodeType::AddMul) {
+            const Affine source = cell(offset);
+            cell(position + update.offset())
+                .AddScaled(source, static_cast<const ast::AddMul&>(update).multiplier());
+          }
         }
+        cell(offset) = Affine();
+        break;
       }
-      if (net_offset != 0 || multipliers[0] != -1) {
+      default:
         return false;
+    }
+  }
+  return position == 0;
+}
+
+}  // namespace
+
+int CollapseAddMulLoops(ast::Tree* tree, int cell_bits) {
+  ArenaScope scope(tree->arena());
+  class AddMulVisitor : public NodeVisitor {
+   public:
+    using NodeVisitor::Visit;
+
+    explicit AddMulVisitor(int cell_bits) : cell_bits_(cell_bits) {}
+
+    NodeList::iterator Visit(ast::Loop* node, NodeList::iterator iter) override {
+      // Inner loops first, so that nested linear loops close from the inside.
+      VisitChildren(node);
+      AttemptReplace(node);
+      return iter;
+    }
+
+    int rewrites = 0;
+
+   private:
+    // A loop whose counter steps by an odd amount `step` runs
+    // -counter * step^-1 times modulo 2^cell_bits. Every other cell it touches
+    // must either be set to a constant, or grow by a constant plus multiples
+    // of such set cells. The latter only reach their steady increment after
+    // the first iteration, which is then kept as a peeled copy of the body.
+    void AttemptReplace(ast::Loop* node) {
+      std::map<int, Affine> cells;
+      if (node->children().empty() || !RunLoopBody(*node, &cells)) {
+        return;
+      }
+      for (auto& [offset, affine] : cells) {
+        affine.Reduce(cell_bits_);
       }
-      // Valid to replace.
-      children.clear();
-      multipliers.erase(0);
-      for (const auto& [offset, multiplier] : multipliers) {
-        children.emplace_back<ast::AddMul>(offset, multiplier);
+      Affine& counter = cells[0];
+      if (counter.coefficients.size() != 1 || counter.coefficients.count(0) == 0 ||
+          counter.coefficients[0] != 1 || counter.constant % 2 == 0) {
+        return;
+      }
+      const uint64_t trips = -InverseOdd(counter.constant);
+
+      std::map<int, uint64_t> sets;
+      for (const auto& [offset, affine] : cells) {
+        if (offset != 0 && affine.coefficients.empty()) {
+          sets[offset] = affine.constant;
+        }
+      }
+      std::map<int, uint64_t> increments;
+      bool peel = false;
+      for (const auto& [offset, affine] : cells) {
+        if (offset == 0 || sets.count(offset) != 0) {
+          continue;
+        }
+        auto self = affine.coefficients.find(offset);
+        if (self == affine.coefficients.end() || self->second != 1) {
+          return;
+        }
+        uint64_t increment = affine.constant;
+        for (const auto& [source, coefficient] : affine.coefficients) {
+          if (source == offset) {
+            continue;
+          }
+          auto set = sets.find(source);
+          if (set == sets.end()) {
+            return;
+          }
+          increment += coefficient * set->second;
+          peel = true;
+        }
+        increments[offset] = increment;
+      }
+
+      // Valid to replace. When peeling, the body has already stepped the
+      // counter, so the AddMuls below cover exactly the remaining iterations.
+      rewrites++;
+      auto& children = node->children();
+      if (!peel) {
+        children.clear();
+        for (const auto& [offset, value] : sets) {
+          children.emplace_back<ast::Set>(WrapToCell(value, cell_bits_), offset);
+        }
+      }
+      for (const auto& [offset, increment] : increments) {
+        const int multiplier = WrapToCell(increment * trips, cell_bits_);
+        if (multiplier != 0) {
+          children.emplace_back<ast::AddMul>(offset, multiplier);
+        }
       }
       children.emplace_back<ast::Set>(0);
-      return false;
     }
-  } visitor;
+
+    const int cell_bits_;
+  } visitor(cell_bits);
   visitor.Visit(tree);
+  return visitor.rewrites;
 }
 
-void ConvertToOffsets(ast::Tree* tree) {
+namespace {
+
+bool ContainsScan(const NodeContainer& container) {
+  for (const Node& node : container.children()) {
+    if (node.type() == NodeType::Scan ||
+        (node.type() == NodeType::Loop && ContainsScan(static_cast<const ast::Loop&>(node)))) {
+      return true;
+    }
+  }
+  return false;
+}
+
+}  // namespace
+
+int ConvertToOffsets(ast::Tree* tree) {
   class OffsetVisitor : public NodeVisitor {
    public:
     using NodeVisitor::Visit;
 
+    // Each flushed Move stands in for at least one Move that was dropped, so
+    // one extra node for the final flush avoids reallocation. `removed_moves`
+    // counts the Moves that were folded away, across nested loops. `base` is
+    // the offset the pending Moves start from and must return to, which for
+    // a loop body is the offset of the loop.
+    OffsetVisitor(const NodeContainer& node, int* removed_moves, int base = 0)
+        : current_offset(base), base(base), removed_moves(removed_moves) {
+      replacement.reserve(node.children().size() + 1);
+    }
+
     NodeList::iterator Visit(ast::Move* node, NodeList::iterator iter) override {
       current_offset += node->distance();
+      (*removed_moves)++;
       return iter;
     }
 
     NodeList::iterator Visit(ast::Add* node, NodeList::iterator iter) override {
-      replacement.emplace_back<ast::Add>(node->amount(), current_offset);
+      replacement.emplace_back<ast::Add>(node->amount(), current_offset + node->offset());
       return iter;
     }
 
     NodeList::iterator Visit(ast::Output* node, NodeList::iterator iter) override {
-      replacement.emplace_back<ast::Output>(current_offset);
+      replacement.emplace_back<ast::Output>(current_offset + node->offset());
       return iter;
     }
 
     NodeList::iterator Visit(ast::Input* node, NodeList::iterator iter) override {
-      replacement.emplace_back<ast::Input>(current_offset);
+      replacement.emplace_back<ast::Input>(current_offset + node->offset());
       return iter;
     }
 
+    // The loop is tested at the pending offset instead of moving there, so
+    // balanced loops need no Moves. A Scan has to start from the pointer
+    // itself, so loops containing one still move there first.
     NodeList::iterator Visit(ast::Loop* node, NodeList::iterator iter) override {
-      FlushOffset();
-      OffsetVisitor visitor;
+      if (ContainsScan(*node)) {
+        FlushOffset();
+      }
+      OffsetVisitor visitor(*node, removed_moves, current_offset);
       visitor.VisitChildren(node);
-      replacement.emplace_back<ast::Loop>(visitor.Build());
+      replacement.emplace_back<ast::Loop>(visitor.Build(), current_offset, node->location());
       return iter;
     }
 
     NodeList::iterator Visit(ast::Set* node, NodeList::iterator iter) {
-      replacement.emplace_back<ast::Set>(node->value(), current_offset);
+      replacement.emplace_back<ast::Set>(node->value(), current_offset + node->offset());
       return iter;
     }
 
     NodeList::iterator Visit(ast::AddMul* node, NodeList::iterator iter) {
+      replacement.emplace_back<ast::AddMul>(current_offset + node->offset(), node->multiplier(),
+                                            current_offset + node->source());
+      return iter;
+    }
+
+    NodeList::iterator Visit(ast::Scan* node, NodeList::iterator iter) override {
       FlushOffset();
-      replacement.emplace_back<ast::AddMul>(node->offset(), node->multiplier());
+      replacement.emplace_back<ast::Scan>(node->stride());
       return iter;
     }
 
     NodeList Build() {
-      FlushOffset();
+      if (current_offset != base) {
+        replacement.emplace_back<ast::Move>(current_offset - base);
+        current_offset = base;
+        (*removed_moves)--;
+      }
       NodeList other;
       other.swap(replacement);
       return other;
@@ -153,17 +488,349 @@ void ConvertToOffsets(ast::Tree* tree) {
 
    private:
     NodeList replacement;
-    int current_offset = 0;
+    int current_offset;
+    const int base;
+    int* const removed_moves;
 
     void FlushOffset() {
       if (current_offset != 0) {
         replacement.emplace_back<ast::Move>(current_offset);
         current_offset = 0;
+        (*removed_moves)--;
       }
     }
-  } visitor;
+  };
+  // Every node is rebuilt, so build into a fresh arena and drop the old one.
+  auto arena = std::make_unique<Arena>();
+  ArenaScope scope(arena.get());
+  int removed_moves = 0;
+  OffsetVisitor visitor(*tree, &removed_moves);
   visitor.Visit(tree);
-  tree->children() = visitor.Build();
+  tree->Reset(visitor.Build(), std::move(arena));
+  return removed_moves;
+}
+
+namespace {
+
+// Cells a loop may write, relative to the pointer at its head, if its body
+// (including nested loops) always returns the pointer to where it started.
+bool CollectBalancedWrites(const NodeContainer& container, int base, std::set<int>* writes) {
+  int position = base;
+  for (const Node& node : container.children()) {
+    switch (node.type()) {
+      case NodeType::Move:
+        position += static_cast<const ast::Move&>(node).distance();
+        break;
+      case NodeType::Add:
+      case NodeType::Set:
+      case NodeType::Input:
+      case NodeType::AddMul:
+        writes->insert(position + node.offset());
+        break;
+      case NodeType::Output:
+      case NodeType::Write:
+        break;
+      case NodeType::Loop:
+        if (!CollectBalancedWrites(static_cast<const ast::Loop&>(node), position, writes)) {
+          return false;
+        }
+        break;
+      default:
+        return false;
+    }
+  }
+  return position == base;
+}
+
+// Whether `loop` always leaves the pointer where it started with its cell
+// zero, so that its body runs at most once.
+bool RunsAtMostOnce(const ast::Loop& loop) {
+  const auto& children = loop.children();
+  if (children.empty() || children.back().type() != NodeType::Set) {
+    return false;
+  }
+  const auto& last = static_cast<const ast::Set&>(children.back());
+  std::set<int> writes;
+  return last.offset() == loop.offset() && last.value() == 0 &&
+         CollectBalancedWrites(loop, 0, &writes);
+}
+
+// Tracks what is known about each cell while walking a block of
+// offset-normalized nodes, and emits only the Sets and Adds needed to bring
+// memory up to date before something reads it.
+class ConstantPropagator {
+ public:
+  explicit ConstantPropagator(int cell_bits) : cell_bits_(cell_bits) {}
+
+  // The tape starts out all zero.
+  NodeList Program(const NodeContainer& tree) {
+    Block block(/*rest_zero=*/true);
+    Run(tree, &block);
+    // Nothing reads the tape or the pointer after the program ends.
+    for (const auto& [offset, cell] : block.cells) {
+      rewrites += cell.pending();
+    }
+    while (!block.out.empty() && block.out.back().type() == NodeType::Move) {
+      block.out.pop_back();
+      rewrites++;
+    }
+    return std::move(block.out);
+  }
+
+  int rewrites = 0;
+
+ private:
+  struct CellState {
+    enum Kind { Unknown, Known, Delta };
+    Kind kind;
+    // The value of a Known cell, or the amount still to be added to a Delta
+    // cell.
+    int value = 0;
+    // Whether a Known value has yet to be stored.
+    bool dirty = false;
+
+    bool pending() const { return kind == Delta || (kind == Known && dirty); }
+  };
+
+  struct Block {
+    explicit Block(bool rest_zero) : rest_zero(rest_zero) {}
+
+    // Keyed by offset from where the pointer was at the start of the block,
+    // or after the last Scan or unbalanced loop.
+    std::map<int, CellState> cells;
+    // Whether cells not in `cells` are known to be zero.
+    bool rest_zero;
+    int position = 0;
+    NodeList out;
+
+    CellState& Cell(int offset) {
+      return cells.try_emplace(position + offset, CellState{rest_zero ? CellState::Known : CellState::Unknown})
+          .first->second;
+    }
+
+    void Forget() {
+      cells.clear();
+      rest_zero = false;
+      position = 0;
+    }
+  };
+
+  const int cell_bits_;
+
+  void Flush(Block* block, int offset) {
+    CellState& cell = block->Cell(offset);
+    if (cell.kind == CellState::Known && cell.dirty) {
+      block->out.emplace_back<ast::Set>(cell.value, offset);
+      cell.dirty = false;
+    } else if (cell.kind == CellState::Delta) {
+      block->out.emplace_back<ast::Add>(cell.value, offset);
+      cell = {CellState::Unknown};
+    }
+  }
+
+  void FlushAll(Block* block) {
+    for (const auto& [absolute, cell] : block->cells) {
+      if (cell.pending()) {
+        Flush(block, absolute - block->position);
+      }
+    }
+  }
+
+  void Add(Block* block, int offset, int amount) {
+    CellState& cell = block->Cell(offset);
+    rewrites += cell.pending();
+    switch (cell.kind) {
+      case CellState::Known:
+        cell = {CellState::Known, WrapToCell(int64_t{cell.value} + amount, cell_bits_), true};
+        break;
+      case CellState::Delta:
+        cell.value = WrapToCell(int64_t{cell.value} + amount, cell_bits_);
+        if (cell.value == 0) {
+          cell = {CellState::Unknown};
+        }
+        break;
+      case CellState::Unknown:
+        cell = {CellState::Delta, amount};
+        break;
+    }
+  }
+
+  void Set(Block* block, int offset, int value) {
+    CellState& cell = block->Cell(offset);
+    if (cell.kind == CellState::Known && cell.value == value) {
+      rewrites++;
+      return;
+    }
+    rewrites += cell.pending();
+    cell = {CellState::Known, value, true};
+  }
+
+  bool KnownZero(Block* block, int offset) {
+    const CellState& cell = block->Cell(offset);
+    return cell.kind == CellState::Known && cell.value == 0;
+  }
+
+  bool KnownNonZero(Block* block, int offset) {
+    const CellState& cell = block->Cell(offset);
+    return cell.kind == CellState::Known && cell.value != 0;
+  }
+
+  void Run(const NodeContainer& container, Block* block) {
+    for (const Node& node : container.children()) {
+      const int offset = node.offset();
+      switch (node.type()) {
+        case NodeType::Move: {
+          const int distance = static_cast<const ast::Move&>(node).distance();
+          block->position += distance;
+          // Dropped loops can leave Moves next to each other.
+          if (!block->out.empty() && block->out.back().type() == NodeType::Move) {
+            const int merged = static_cast<const ast::Move&>(block->out.back()).distance() + distance;
+            block->out.pop_back();
+            rewrites++;
+            if (merged == 0) {
+              break;
+            }
+            block->out.emplace_back<ast::Move>(merged);
+          } else {
+            block->out.emplace_back<ast::Move>(distance);
+          }
+          break;
+        }
+        case NodeType::Add:
+          Add(block, offset, static_cast<const ast::Add&>(node).amount());
+          break;
+        case NodeType::Set:
+          Set(block, offset, static_cast<const ast::Set&>(node).value());
+          break;
+        case NodeType::Output:
+          Flush(block, offset);
+          block->out.emplace_back<ast::Output>(offset);
+          break;
+        case NodeType::Write: {
+          const auto& offsets = static_cast<const ast::Write&>(node).offsets();
+          for (int cell : offsets) {
+            Flush(block, cell);
+          }
+          block->out.emplace_back<ast::Write>(std::vector<int>(offsets.begin(), offsets.end()));
+          break;
+        }
+        case NodeType::Input:
+          // Flushed rather than dropped: input may leave the cell unchanged
+          // at EOF.
+          Flush(block, offset);
+          block->out.emplace_back<ast::Input>(offset);
+          block->Cell(offset) = {CellState::Unknown};
+          break;
+        case NodeType::AddMul: {
+          const int multiplier = static_cast<const ast::AddMul&>(node).multiplier();
+          const int source_offset = static_cast<const ast::AddMul&>(node).source();
+          const CellState& source = block->Cell(source_offset);
+          if (source.kind == CellState::Known) {
+            rewrites++;
+            if (source.value != 0) {
+              Add(block, offset, WrapToCell(int64_t{source.value} * multiplier, cell_bits_));
+            }
+            break;
+          }
+          Flush(block, source_offset);
+          // A pending Delta commutes with the addition, so it can stay pending.
+          CellState& target = block->Cell(offset);
+          if (target.kind == CellState::Known) {
+            Flush(block, offset);
+            target = {CellState::Unknown};
+          }
+          block->out.emplace_back<ast::AddMul>(offset, multiplier, source_offset);
+          break;
+        }
+        case NodeType::Scan:
+          if (KnownZero(block, 0)) {
+            rewrites++;
+            break;
+          }
+          FlushAll(block);
+          block->out.emplace_back<ast::Scan>(static_cast<const ast::Scan&>(node).stride());
+          block->Forget();
+          block->Cell(0) = {CellState::Known, 0};
+          break;
+        case NodeType::Loop: {
+          const ast::Loop& loop = static_cast<const ast::Loop&>(node);
+          if (KnownZero(block, offset)) {
+            rewrites++;
+            break;
+          }
+          if (KnownNonZero(block, offset) && RunsAtMostOnce(loop)) {
+            // Runs exactly once, so it is straight-line code.
+            rewrites++;
+            Run(loop, block);
+            break;
+          }
+          FlushAll(block);
+          Block body(/*rest_zero=*/false);
+          Run(loop, &body);
+          FlushAll(&body);
+          block->out.emplace_back<ast::Loop>(std::move(body.out), offset, loop.location());
+          std::set<int> writes;
+          if (CollectBalancedWrites(loop, 0, &writes)) {
+            for (int cell : writes) {
+              block->Cell(cell) = {CellState::Unknown};
+            }
+          } else {
+            block->Forget();
+          }
+          block->Cell(offset) = {CellState::Known, 0};
+          break;
+        }
+        default:
+          LOG(FATAL) << "Unexpected node: " << node.DebugString();
+      }
+    }
+  }
+};
+
+}  // namespace
+
+int PropagateConstants(ast::Tree* tree, int cell_bits) {
+  // Every node is rebuilt, so build into a fresh arena and drop the old one.
+  auto arena = std::make_unique<Arena>();
+  ArenaScope scope(arena.get());
+  ConstantPropagator propagator(cell_bits);
+  NodeList children = propagator.Program(*tree);
+  tree->Reset(std::move(children), std::move(arena));
+  return propagator.rewrites;
+}
+
+int FuseOutputs(ast::Tree* tree) {
+  ArenaScope scope(tree->arena());
+  class FuseVisitor : public NodeVisitor {
+   public:
+    using NodeVisitor::Visit;
+
+    NodeList::iterator Visit(ast::Loop* node, NodeList::iterator iter) override {
+      Fuse(node);
+      return iter;
+    }
+
+    void Fuse(NodeContainer* node) {
+      auto& children = node->children();
+      for (auto iter = children.begin(); iter != children.end(); ++iter) {
+        auto run_end = iter;
+        std::vector<int> offsets;
+        for (; run_end != children.end() && run_end->type() == NodeType::Output; ++run_end) {
+          offsets.push_back(run_end->offset());
+        }
+        if (offsets.size() > 1) {
+          iter.replace<ast::Write>(std::move(offsets));
+          children.erase(iter + 1, run_end);
+          rewrites++;
+        }
+      }
+      VisitChildren(node);
+    }
+
+    int rewrites = 0;
+  } visitor;
+  visitor.Fuse(tree);
+  return visitor.rewrites;
 }
 
 }  // dev::spiralgerbil::bf
@@ -1,18 +1,42 @@
 #ifndef DEV_SPIRALGERBIL_BF_OPTIMIZER_AST_H_
 #define DEV_SPIRALGERBIL_BF_OPTIMIZER_AST_H_
 
+#include <cstdint>
 #include <memory>
 
 #include "bf/compiler/ast.h"
+#include "bf/compiler/partial_eval.h"
+#include "bf/compiler/pass_manager.h"
+#include "bf/compiler/pgo.h"
 
 namespace dev::spiralgerbil::bf {
 
-void Optimize(ast::Tree* program);
+// `cell_bits` is the width of the cells the program will run with, as
+// constants are folded modulo 2^cell_bits.
+void Optimize(ast::Tree* program, int cell_bits);
 
-void CollapseClearLoops(ast::Tree* tree);
-void RemoveImpossibleLoops(ast::Tree* tree);
-void CollapseAddMulLoops(ast::Tree* tree);
-void ConvertToOffsets(ast::Tree* tree);
+// Registers the passes Optimize runs, for callers that want to control the
+// iteration budget or inspect the statistics. If `profile` is given, it must
+// outlive the pass manager, and ApplyProfile runs last. PartiallyEvaluate
+// runs before it with `partial_eval_budget`, unless that is zero.
+void AddDefaultPasses(PassManager* pass_manager, int cell_bits,
+                      const SavedProfile* profile = nullptr,
+                      int64_t partial_eval_budget = DefaultPartialEvalBudget);
+
+// Each pass returns the number of rewrites it made.
+int FoldConstants(ast::Tree* tree, int cell_bits);
+int CollapseClearLoops(ast::Tree* tree);
+int CollapseScanLoops(ast::Tree* tree);
+int RemoveImpossibleLoops(ast::Tree* tree);
+// Closes balanced loops whose counter steps by an odd amount and whose other
+// cells change affinely, including loops over already collapsed inner loops.
+int CollapseAddMulLoops(ast::Tree* tree, int cell_bits);
+int ConvertToOffsets(ast::Tree* tree);
+// Runs after ConvertToOffsets. Folds the Adds and Sets of each block, drops
+// stores that are overwritten or never read, and removes loops and AddMuls
+// whose cell is known to be zero.
+int PropagateConstants(ast::Tree* tree, int cell_bits);
+int FuseOutputs(ast::Tree* tree);
 
 }  // dev::spiralgerbil::bf
 
@@ -1,72 +1,163 @@
 #include "bf/compiler/parser.h"
 
 #include <iterator>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
 
 namespace dev::spiralgerbil::bf {
 namespace {
 
-NodeList ParseNodeList(std::istream* token_stream, bool head) {
-  NodeList nodes;
-  int repeat_count = 0;
-  char token;
-  while (token = token_stream->get(), !token_stream->eof()) {
-    switch (token) {
-      case '>':
-        repeat_count++;
-        if (token_stream->peek() != '>') {
-          nodes.emplace_back<ast::Move>(repeat_count);
-          repeat_count = 0;
-        }
-        break;
-      case '<':
-        repeat_count++;
-        if (token_stream->peek() != '<') {
-          nodes.emplace_back<ast::Move>(-repeat_count);
-          repeat_count = 0;
-        }
-        break;
-      case '+':
-        repeat_count++;
-        if (token_stream->peek() != '+') {
-          nodes.emplace_back<ast::Add>(repeat_count);
-          repeat_count = 0;
-        }
-        break;
-      case '-':
-        repeat_count++;
-        if (token_stream->peek() != '-') {
-          nodes.emplace_back<ast::Add>(-repeat_count);
-          repeat_count = 0;
+class Parser {
+ public:
+  explicit Parser(std::string_view source) : source_(source) {}
+
+  bool done() const { return pos_ == source_.size(); }
+
+  // Why the source does not parse, or empty if it does.
+  std::string error() const {
+    if (!unclosed_.empty()) {
+      return unclosed_;
+    }
+    if (!done()) {
+      // The stray ] is the next token.
+      return "Unmatched ] at " + Position(line_, pos_ - line_start_ + 1);
+    }
+    return "";
+  }
+
+  // Parses up to the ] that closes the loop whose [ is at `loop`, or at the
+  // top level, where `loop` is null, up to the end or a stray ].
+  NodeList ParseNodeList(const SourceLocation* loop) {
+    // Collect nodes in reusable scratch space and copy them out once the
+    // length is known, so that growth never leaves garbage in the arena.
+    if (depth_ == scratch_.size()) {
+      scratch_.emplace_back();
+    }
+    depth_++;
+    while (!done()) {
+      const char token = source_[pos_++];
+      switch (token) {
+        case '>':
+          Emit<ast::Move>(1 + CountRepeats('>'));
+          break;
+        case '<':
+          Emit<ast::Move>(-1 - CountRepeats('<'));
+          break;
+        case '+':
+          Emit<ast::Add>(1 + CountRepeats('+'));
+          break;
+        case '-':
+          Emit<ast::Add>(-1 - CountRepeats('-'));
+          break;
+        case '.':
+          Emit<ast::Output>();
+          break;
+        case ',':
+          Emit<ast::Input>();
+          break;
+        case '[': {
+          const SourceLocation location{line_, static_cast<int>(pos_ - line_start_)};
+          Emit<ast::Loop>(ParseNodeList(&location), 0, location);
+          break;
         }
-        break;
-      case '.':
-        nodes.emplace_back<ast::Output>();
-        break;
-      case ',':
-        nodes.emplace_back<ast::Input>();
-        break;
-      case '[':
-        nodes.emplace_back<ast::Loop>(ParseNodeList(token_stream, false));
-        break;
-      case ']':
-        return nodes;
-      default:
-        break;
+        case ']':
+          if (loop == nullptr) {
+            // Leave the stray ] unconsumed so the caller can report it.
+            pos_--;
+          }
+          return Collect();
+        case '\n':
+          line_++;
+          line_start_ = pos_;
+          break;
+        default:
+          break;
+      }
     }
+    // The innermost loop left open is reported.
+    if (loop != nullptr && unclosed_.empty()) {
+      unclosed_ = "Unmatched [ at " + Position(loop->line, loop->column);
+    }
+    return Collect();
   }
-  LOG_IF(FATAL, !head) << "Unmatched [";
-  return nodes;
+
+ private:
+  const std::string_view source_;
+  size_t pos_ = 0;
+  int line_ = 1;
+  size_t line_start_ = 0;
+  std::vector<std::vector<std::unique_ptr<Node>>> scratch_;
+  size_t depth_ = 0;
+  std::string unclosed_;
+
+  static std::string Position(int line, int column) {
+    return std::to_string(line) + ":" + std::to_string(column);
+  }
+
+  template <typename V, typename... Args>
+  void Emit(Args&&... args) {
+    scratch_[depth_ - 1].push_back(std::make_unique<V>(std::forward<Args>(args)...));
+  }
+
+  NodeList Collect() {
+    depth_--;
+    auto& scratch = scratch_[depth_];
+    NodeList nodes;
+    nodes.reserve(scratch.size());
+    for (auto& node : scratch) {
+      nodes.push_back(std::move(node));
+    }
+    scratch.clear();
+    return nodes;
+  }
+
+  // Consumes and counts immediate repeats of the token just read.
+  int CountRepeats(char token) {
+    const size_t start = pos_;
+    while (!done() && source_[pos_] == token) {
+      pos_++;
+    }
+    return pos_ - start;
+  }
+};
+
+std::unique_ptr<ast::Tree> ParseTree(Parser* parser) {
+  auto arena = std::make_unique<Arena>();
+  NodeList program;
+  {
+    ArenaScope scope(arena.get());
+    program = parser->ParseNodeList(nullptr);
+  }
+  return std::make_unique<ast::Tree>(std::move(program), std::move(arena));
 }
 
 }  // namespace
 
+std::unique_ptr<ast::Tree> Parse(std::string_view source) {
+  Parser parser(source);
+  std::unique_ptr<ast::Tree> program = ParseTree(&parser);
+  const std::string error = parser.error();
+  // A stray ] ends the program early, but a loop left open cannot run.
+  if (!parser.done()) {
+    LOG(ERROR) << error;
+  } else {
+    LOG_IF(FATAL, !error.empty()) << error;
+  }
+  return program;
+}
+
+std::unique_ptr<ast::Tree> Parse(std::string_view source, std::string* error) {
+  Parser parser(source);
+  std::unique_ptr<ast::Tree> program = ParseTree(&parser);
+  *error = parser.error();
+  return error->empty() ? std::move(program) : nullptr;
+}
 
 std::unique_ptr<ast::Tree> Parse(std::istream* token_stream) {
-  NodeList program = ParseNodeList(token_stream, true);
-  if (!token_stream->eof()) {
-    LOG(ERROR) << "Unmatched ]";
-  }
-  return std::make_unique<ast::Tree>(std::move(program));
+  const std::string source(std::istreambuf_iterator<char>(*token_stream), {});
+  return Parse(source);
 }
 
-}  // namespace dev::spiralgerbil::bf
\ No newline at end of file
+}  // namespace dev::spiralgerbil::bf
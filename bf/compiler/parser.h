@@ -3,12 +3,19 @@
 
 #include <istream>
 #include <memory>
+#include <string>
+#include <string_view>
 
 #include "bf/compiler/ast.h"
 
 namespace dev::spiralgerbil::bf {
 
+std::unique_ptr<ast::Tree> Parse(std::string_view source);
 std::unique_ptr<ast::Tree> Parse(std::istream* input_stream);
+// Returns null, with the reason and the line and column of the bracket in
+// `*error`, if `source` has an unmatched [ or ], instead of dying or stopping
+// at it.
+std::unique_ptr<ast::Tree> Parse(std::string_view source, std::string* error);
 
 }  // namespace dev::spiralgerbil::bf
 
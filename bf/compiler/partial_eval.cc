@@ -0,0 +1,275 @@
+#include "bf/compiler/partial_eval.h"
+
+#include <algorithm>
+#include <array>
+#include <climits>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "glog/logging.h"
+
+#include "bf/compiler/cell.h"
+
+namespace dev::spiralgerbil::bf {
+namespace {
+
+// Tapes are whole pages, so even the smallest has this many 32-bit cells, and
+// the residual program never sets a cell the original could not reach.
+constexpr int64_t MaxCells = 1024;
+// Each byte printed ahead of time takes a record in the compiled program.
+constexpr size_t MaxOutput = 4096;
+
+class Evaluator {
+ public:
+  Evaluator(int cell_bits, int64_t budget)
+      : cell_bits_(cell_bits), budget_(budget), tape_(MaxCells) {}
+
+  // Runs the nodes of `program`, returning the index of the one to resume
+  // from, or its size if they all ran. A stop inside a loop goes back to the
+  // start of the loop's trip around the top level, so that the rest of the
+  // program is the rest of its nodes and no loop body has to be split.
+  size_t Run(const NodeList& program) {
+    for (size_t index = 0; index < program.size(); index++) {
+      if (!Step(program[index], /*top_level=*/true)) {
+        Rollback();
+        return index;
+      }
+    }
+    return program.size();
+  }
+
+  int64_t steps() const { return steps_; }
+  int64_t pointer() const { return pointer_; }
+  const std::vector<int32_t>& tape() const { return tape_; }
+  const std::string& output() const { return output_; }
+
+ private:
+  const int cell_bits_;
+  const int64_t budget_;
+  int64_t steps_ = 0;
+  int64_t pointer_ = 0;
+  std::vector<int32_t> tape_;
+  std::string output_;
+
+  // The state at the last checkpoint, and the old values of the cells stored
+  // to since, latest last.
+  int64_t checkpoint_steps_ = 0;
+  int64_t checkpoint_pointer_ = 0;
+  size_t checkpoint_output_ = 0;
+  std::vector<std::pair<int64_t, int32_t>> undo_;
+
+  void Checkpoint() {
+    checkpoint_steps_ = steps_;
+    checkpoint_pointer_ = pointer_;
+    checkpoint_output_ = output_.size();
+    undo_.clear();
+  }
+
+  void Rollback() {
+    for (auto iter = undo_.rbegin(); iter != undo_.rend(); ++iter) {
+      tape_[iter->first] = iter->second;
+    }
+    undo_.clear();
+    steps_ = checkpoint_steps_;
+    pointer_ = checkpoint_pointer_;
+    output_.resize(checkpoint_output_);
+  }
+
+  bool InBounds(int offset) const {
+    return pointer_ + offset >= 0 && pointer_ + offset < MaxCells;
+  }
+
+  int32_t Load(int offset) const { return tape_[pointer_ + offset]; }
+
+  void Store(int offset, int64_t value) {
+    undo_.emplace_back(pointer_ + offset, Load(offset));
+    tape_[pointer_ + offset] = WrapToCell(value, cell_bits_);
+  }
+
+  // Returns false if it stopped before `node` or inside it.
+  bool Step(const Node& node, bool top_level = false) {
+    if (top_level) {
+      Checkpoint();
+    }
+    if (steps_ >= budget_ || !InBounds(node.offset())) {
+      return false;
+    }
+    switch (node.type()) {
+      case NodeType::Move: {
+        const int distance = static_cast<const ast::Move&>(node).distance();
+        if (!InBounds(distance)) {
+          return false;
+        }
+        pointer_ += distance;
+        break;
+      }
+      case NodeType::Add:
+        Store(node.offset(), int64_t{Load(node.offset())} +
+                                 static_cast<const ast::Add&>(node).amount());
+        break;
+      case NodeType::Output:
+        if (output_.size() == MaxOutput) {
+          return false;
+        }
+        output_.push_back(static_cast<char>(Load(node.offset())));
+        break;
+      case NodeType::Input:
+        return false;
+      case NodeType::Loop:
+        while (Load(node.offset()) != 0) {
+          // A loop about to go around again is as good as one not yet
+          // entered.
+          if (top_level) {
+            Checkpoint();
+          }
+          if (steps_ >= budget_) {
+            return false;
+          }
+          steps_++;
+          for (const Node& child : static_cast<const ast::Loop&>(node).children()) {
+            if (!Step(child)) {
+              return false;
+            }
+          }
+        }
+        break;
+      case NodeType::Set:
+        Store(node.offset(), static_cast<const ast::Set&>(node).value());
+        break;
+      case NodeType::AddMul: {
+        const auto& addmul = static_cast<const ast::AddMul&>(node);
+        if (!InBounds(addmul.source())) {
+          return false;
+        }
+        Store(node.offset(),
+              Load(node.offset()) + int64_t{Load(addmul.source())} * addmul.multiplier());
+        break;
+      }
+      case NodeType::Write: {
+        const auto& offsets = static_cast<const ast::Write&>(node).offsets();
+        if (output_.size() + offsets.size() > MaxOutput ||
+            !std::all_of(offsets.begin(), offsets.end(),
+                         [this](int offset) { return InBounds(offset); })) {
+          return false;
+        }
+        for (int offset : offsets) {
+          output_.push_back(static_cast<char>(Load(offset)));
+        }
+        break;
+      }
+      case NodeType::Scan: {
+        const int stride = static_cast<const ast::Scan&>(node).stride();
+        while (Load(0) != 0) {
+          if (!InBounds(stride)) {
+            return false;
+          }
+          pointer_ += stride;
+        }
+        break;
+      }
+      default:
+        LOG(FATAL) << "Unexpected node: " << node.DebugString();
+    }
+    steps_++;
+    return true;
+  }
+};
+
+void CopyNode(const Node& node, NodeList* output) {
+  switch (node.type()) {
+    case NodeType::Move:
+      output->emplace_back<ast::Move>(static_cast<const ast::Move&>(node).distance());
+      break;
+    case NodeType::Add:
+      output->emplace_back<ast::Add>(static_cast<const ast::Add&>(node).amount(), node.offset());
+      break;
+    case NodeType::Output:
+      output->emplace_back<ast::Output>(node.offset());
+      break;
+    case NodeType::Input:
+      output->emplace_back<ast::Input>(node.offset());
+      break;
+    case NodeType::Loop: {
+      const auto& loop = static_cast<const ast::Loop&>(node);
+      NodeList body;
+      for (const Node& child : loop.children()) {
+        CopyNode(child, &body);
+      }
+      output->emplace_back<ast::Loop>(std::move(body), node.offset(), loop.location())
+          .set_hints(loop.hints());
+      break;
+    }
+    case NodeType::Set:
+      output->emplace_back<ast::Set>(static_cast<const ast::Set&>(node).value(), node.offset());
+      break;
+    case NodeType::AddMul: {
+      const auto& addmul = static_cast<const ast::AddMul&>(node);
+      output->emplace_back<ast::AddMul>(node.offset(), addmul.multiplier(), addmul.source());
+      break;
+    }
+    case NodeType::Write: {
+      const auto& offsets = static_cast<const ast::Write&>(node).offsets();
+      output->emplace_back<ast::Write>(std::vector<int>(offsets.begin(), offsets.end()));
+      break;
+    }
+    case NodeType::Scan:
+      output->emplace_back<ast::Scan>(static_cast<const ast::Scan&>(node).stride());
+      break;
+    default:
+      LOG(FATAL) << "Unexpected node: " << node.DebugString();
+  }
+}
+
+}  // namespace
+
+int PartiallyEvaluate(ast::Tree* tree, int cell_bits, int64_t budget) {
+  Evaluator evaluator(cell_bits, budget);
+  const size_t resume = evaluator.Run(tree->children());
+  if (evaluator.steps() == 0) {
+    return 0;
+  }
+
+  auto arena = std::make_unique<Arena>();
+  ArenaScope scope(arena.get());
+  NodeList residual;
+  // The output is printed from cells at the start of the tape, one for each
+  // distinct byte, which are set to their final values afterwards.
+  std::array<int, 256> cell_of_byte;
+  cell_of_byte.fill(-1);
+  std::vector<int32_t> scratch;
+  std::vector<int> offsets;
+  for (char c : evaluator.output()) {
+    const auto byte = static_cast<unsigned char>(c);
+    if (cell_of_byte[byte] < 0) {
+      cell_of_byte[byte] = scratch.size();
+      scratch.push_back(WrapToCell(byte, cell_bits));
+      residual.emplace_back<ast::Set>(scratch.back(), cell_of_byte[byte]);
+    }
+    offsets.push_back(cell_of_byte[byte]);
+  }
+  if (!offsets.empty()) {
+    residual.emplace_back<ast::Write>(offsets);
+  }
+  // Nothing reads the tape after the last node.
+  const NodeList& program = tree->children();
+  if (resume < program.size()) {
+    const std::vector<int32_t>& tape = evaluator.tape();
+    for (size_t cell = 0; cell < tape.size(); cell++) {
+      if (tape[cell] != (cell < scratch.size() ? scratch[cell] : 0)) {
+        residual.emplace_back<ast::Set>(tape[cell], cell);
+      }
+    }
+    if (evaluator.pointer() != 0) {
+      residual.emplace_back<ast::Move>(evaluator.pointer());
+    }
+  }
+  for (size_t index = resume; index < program.size(); index++) {
+    CopyNode(program[index], &residual);
+  }
+  tree->Reset(std::move(residual), std::move(arena));
+  return std::min<int64_t>(evaluator.steps(), INT_MAX);
+}
+
+}  // namespace dev::spiralgerbil::bf
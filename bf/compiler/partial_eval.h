@@ -0,0 +1,25 @@
+#ifndef DEV_SPIRALGERBIL_BF_COMPILER_PARTIAL_EVAL_H_
+#define DEV_SPIRALGERBIL_BF_COMPILER_PARTIAL_EVAL_H_
+
+#include <cstdint>
+
+#include "bf/compiler/ast.h"
+
+namespace dev::spiralgerbil::bf {
+
+// Nodes PartiallyEvaluate may run, which takes a few milliseconds.
+constexpr int64_t DefaultPartialEvalBudget = int64_t{1} << 20;
+
+// Runs after the other passes. Every run of a program is the same until it
+// first reads input, so this runs the program that far while compiling, from
+// a blank tape, and replaces what it ran with Sets and a Write that print the
+// same output, Sets that leave the tape as it was then, a Move to where the
+// pointer was, and the nodes that were still to run. It stops early, before
+// the node that would exceed it, once `budget` nodes have run, or before
+// printing too much or touching a cell that a small tape might not have.
+// Returns the number of nodes run ahead of time.
+int PartiallyEvaluate(ast::Tree* tree, int cell_bits, int64_t budget = DefaultPartialEvalBudget);
+
+}  // namespace dev::spiralgerbil::bf
+
+#endif  // DEV_SPIRALGERBIL_BF_COMPILER_PARTIAL_EVAL_H_
@@ -0,0 +1,88 @@
+#include "bf/compiler/pass_manager.h"
+
+#include <utility>
+
+#include "absl/strings/str_format.h"
+#include "absl/time/clock.h"
+
+namespace dev::spiralgerbil::bf {
+
+size_t CountNodes(const NodeContainer& container) {
+  size_t count = 0;
+  for (const Node& node : container.children()) {
+    count++;
+    if (node.type() == NodeType::Loop) {
+      count += CountNodes(static_cast<const ast::Loop&>(node));
+    }
+  }
+  return count;
+}
+
+void PassManager::AddPass(std::string name, Pass pass) {
+  passes_.push_back({std::move(pass), stats_.size()});
+  stats_.push_back({std::move(name)});
+}
+
+void PassManager::AddFinalPass(std::string name, Pass pass) {
+  final_passes_.push_back({std::move(pass), stats_.size()});
+  stats_.push_back({std::move(name)});
+}
+
+int PassManager::RunPass(Entry* entry, ast::Tree* tree) {
+  Stats& stats = stats_[entry->stats_index];
+  if (count_nodes_ && stats.runs == 0) {
+    stats.nodes_before = CountNodes(*tree);
+  }
+  const absl::Time start = absl::Now();
+  const int rewrites = entry->pass(tree);
+  stats.time += absl::Now() - start;
+  stats.runs++;
+  stats.rewrites += rewrites;
+  if (count_nodes_) {
+    stats.nodes_after = CountNodes(*tree);
+  }
+  total_rewrites_ += rewrites;
+  entry->rewrites_seen = total_rewrites_;
+  return rewrites;
+}
+
+void PassManager::Run(ast::Tree* tree) {
+  for (Stats& stats : stats_) {
+    stats = {std::move(stats.name)};
+  }
+  for (Entry& entry : passes_) {
+    entry.rewrites_seen = -1;
+  }
+  total_rewrites_ = 0;
+  reached_fixpoint_ = false;
+  for (iterations_ = 0; iterations_ < max_iterations_ && !reached_fixpoint_; iterations_++) {
+    int rewrites = 0;
+    for (Entry& entry : passes_) {
+      if (entry.rewrites_seen != total_rewrites_) {
+        rewrites += RunPass(&entry, tree);
+      }
+    }
+    reached_fixpoint_ = rewrites == 0;
+  }
+  for (Entry& entry : final_passes_) {
+    RunPass(&entry, tree);
+  }
+}
+
+std::string PassManager::StatsString() const {
+  std::string result = absl::StrFormat("%-24s %5s %9s %10s %10s %12s\n", "pass", "runs",
+                                       "rewrites", "nodes in", "nodes out", "time");
+  absl::Duration total;
+  for (const Stats& stats : stats_) {
+    absl::StrAppendFormat(&result, "%-24s %5d %9d %10d %10d %12s\n", stats.name, stats.runs,
+                          stats.rewrites, stats.nodes_before, stats.nodes_after,
+                          absl::FormatDuration(stats.time));
+    total += stats.time;
+  }
+  absl::StrAppendFormat(&result, "%d iterations, %s, %s total\n", iterations_,
+                        reached_fixpoint_ ? "fixpoint reached" : "budget exhausted",
+                        absl::FormatDuration(total));
+  return result;
+}
+
+}  // namespace dev::spiralgerbil::bf
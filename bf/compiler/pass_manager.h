@@ -0,0 +1,84 @@
+#ifndef DEV_SPIRALGERBIL_BF_COMPILER_PASS_MANAGER_H_
+#define DEV_SPIRALGERBIL_BF_COMPILER_PASS_MANAGER_H_
+
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "absl/time/time.h"
+
+#include "bf/compiler/ast.h"
+
+namespace dev::spiralgerbil::bf {
+
+// Runs optimization passes over a tree and records what each of them did.
+//
+// Passes added with AddPass are repeated in order until an iteration makes no
+// rewrites or the iteration budget runs out, so that one pass can pick up
+// opportunities exposed by another. They must be idempotent, as a pass is
+// skipped if nothing changed since it last ran. Passes added with AddFinalPass
+// then run once each, for lowerings that must not be repeated.
+class PassManager {
+ public:
+  // Returns the number of rewrites made. Zero means the pass found nothing to
+  // do.
+  using Pass = std::function<int(ast::Tree*)>;
+
+  struct Stats {
+    std::string name;
+    int runs = 0;
+    int rewrites = 0;
+    absl::Duration time;
+    // Before the first run and after the last, if node counting is enabled.
+    size_t nodes_before = 0;
+    size_t nodes_after = 0;
+  };
+
+  static constexpr int DefaultMaxIterations = 8;
+
+  // Counting nodes walks the whole tree around every pass, so it is only done
+  // if asked for.
+  explicit PassManager(int max_iterations = DefaultMaxIterations, bool count_nodes = false)
+      : max_iterations_(max_iterations), count_nodes_(count_nodes) {}
+
+  void AddPass(std::string name, Pass pass);
+  void AddFinalPass(std::string name, Pass pass);
+
+  void Run(ast::Tree* tree);
+
+  // Iterations of the repeated passes in the last Run, and whether they
+  // stopped because nothing changed rather than because of the budget.
+  int iterations() const { return iterations_; }
+  bool reached_fixpoint() const { return reached_fixpoint_; }
+
+  // One entry per pass, in the order they were added.
+  const std::vector<Stats>& stats() const { return stats_; }
+  std::string StatsString() const;
+
+ private:
+  struct Entry {
+    Pass pass;
+    size_t stats_index;
+    // The value of total_rewrites_ after the pass last ran.
+    long rewrites_seen = -1;
+  };
+
+  int RunPass(Entry* entry, ast::Tree* tree);
+
+  const int max_iterations_;
+  const bool count_nodes_;
+  std::vector<Entry> passes_;
+  std::vector<Entry> final_passes_;
+  std::vector<Stats> stats_;
+  long total_rewrites_ = 0;
+  int iterations_ = 0;
+  bool reached_fixpoint_ = false;
+};
+
+// The number of nodes below `container`, at any depth.
+size_t CountNodes(const NodeContainer& container);
+
+}  // namespace dev::spiralgerbil::bf
+
+#endif  // DEV_SPIRALGERBIL_BF_COMPILER_PASS_MANAGER_H_
@@ -0,0 +1,256 @@
+#include "bf/compiler/pgo.h"
+
+#include <algorithm>
+#include <sstream>
+#include <utility>
+#include <vector>
+
+#include "glog/logging.h"
+
+#include "bf/compiler/cell.h"
+#include "bf/compiler/fnv1a.h"
+#include "bf/compiler/pass_manager.h"
+
+namespace dev::spiralgerbil::bf {
+namespace {
+
+constexpr char Magic[] = "bf-profile";
+
+// A loop is hot if it executed at least this share of all nodes.
+constexpr uint64_t HotPercent = 1;
+// Unrolling pays off for loops that go around this often per entry.
+constexpr uint64_t MinTripsToUnroll = 4;
+constexpr size_t MaxUnrolledNodes = 32;
+// Specializing needs the entry value to be this common.
+constexpr uint64_t DominantPercent = 90;
+constexpr size_t MaxSpecializedNodes = 64;
+// How much the hints may grow the program, relative to its size, though small
+// programs may always grow by MinGrowth nodes.
+constexpr size_t GrowthPercent = 50;
+constexpr size_t MinGrowth = 64;
+
+uint64_t HashLoop(const ast::Loop& loop, absl::flat_hash_map<const ast::Loop*, uint64_t>* hashes) {
+  const int base = loop.offset();
+  Fnv1a hash;
+  hash.Add(static_cast<int64_t>(loop.children().size()));
+  for (const Node& node : loop.children()) {
+    hash.Add(static_cast<int>(node.type()));
+    hash.Add(node.offset() - base);
+    switch (node.type()) {
+      case NodeType::Move:
+        hash.Add(static_cast<const ast::Move&>(node).distance());
+        break;
+      case NodeType::Add:
+        hash.Add(static_cast<const ast::Add&>(node).amount());
+        break;
+      case NodeType::Loop:
+        hash.Add(HashLoop(static_cast<const ast::Loop&>(node), hashes));
+        break;
+      case NodeType::Set:
+        hash.Add(static_cast<const ast::Set&>(node).value());
+        break;
+      case NodeType::AddMul: {
+        const auto& addmul = static_cast<const ast::AddMul&>(node);
+        hash.Add(addmul.multiplier());
+        hash.Add(addmul.source() - base);
+        break;
+      }
+      case NodeType::Write: {
+        const auto& offsets = static_cast<const ast::Write&>(node).offsets();
+        hash.Add(static_cast<int64_t>(offsets.size()));
+        for (int offset : offsets) {
+          hash.Add(offset - base);
+        }
+        break;
+      }
+      case NodeType::Scan:
+        hash.Add(static_cast<const ast::Scan&>(node).stride());
+        break;
+      default:
+        break;
+    }
+  }
+  (*hashes)[&loop] = hash.state();
+  return hash.state();
+}
+
+void CollectLoops(NodeContainer* container, std::vector<ast::Loop*>* loops) {
+  for (Node& node : container->children()) {
+    if (node.type() == NodeType::Loop) {
+      auto* loop = static_cast<ast::Loop*>(&node);
+      loops->push_back(loop);
+      CollectLoops(loop, loops);
+    }
+  }
+}
+
+// Whether `container` leaves the pointer where it is and only changes the
+// cell at `counter` through Adds directly below `loop`, which are added to
+// `step`.
+bool FindStep(const NodeContainer& container, const ast::Loop& loop, int counter, int64_t* step) {
+  for (const Node& node : container.children()) {
+    switch (node.type()) {
+      case NodeType::Move:
+      case NodeType::Scan:
+        return false;
+      case NodeType::Add:
+        if (node.offset() == counter) {
+          if (&container != &loop) {
+            return false;
+          }
+          *step += static_cast<const ast::Add&>(node).amount();
+        }
+        break;
+      case NodeType::Input:
+      case NodeType::Set:
+      case NodeType::AddMul:
+        if (node.offset() == counter) {
+          return false;
+        }
+        break;
+      case NodeType::Loop:
+        if (!FindStep(static_cast<const ast::Loop&>(node), loop, counter, step)) {
+          return false;
+        }
+        break;
+      default:
+        break;
+    }
+  }
+  return true;
+}
+
+// The number of times `loop` runs when it starts with its cell equal to
+// `entry_value`, or zero if that is not known or more than
+// LoopHints::MaxTripCount.
+int TripCount(const ast::Loop& loop, int entry_value, int cell_bits) {
+  int64_t step = 0;
+  if (!FindStep(loop, loop, loop.offset(), &step)) {
+    return 0;
+  }
+  int64_t value = WrapToCell(entry_value, cell_bits);
+  for (int trips = 1; value != 0 && trips <= LoopHints::MaxTripCount; trips++) {
+    value = WrapToCell(value + step, cell_bits);
+    if (value == 0) {
+      return trips;
+    }
+  }
+  return 0;
+}
+
+}  // namespace
+
+absl::flat_hash_map<const ast::Loop*, uint64_t> HashLoops(const ast::Tree& program) {
+  absl::flat_hash_map<const ast::Loop*, uint64_t> hashes;
+  for (const Node& node : program.children()) {
+    if (node.type() == NodeType::Loop) {
+      HashLoop(static_cast<const ast::Loop&>(node), &hashes);
+    }
+  }
+  return hashes;
+}
+
+bool SavedProfile::Parse(std::string_view text) {
+  *this = SavedProfile();
+  std::istringstream input{std::string(text)};
+  std::string magic;
+  int version;
+  CHECK(input >> magic >> version && magic == Magic) << "Not a loop profile";
+  if (version != Version) {
+    return false;
+  }
+  std::string key;
+  CHECK(input >> key >> cell_bits_ && key == "cell_bits") << "Malformed loop profile";
+  CHECK(input >> key >> total_nodes_ && key == "total_nodes") << "Malformed loop profile";
+  uint64_t hash;
+  Loop loop;
+  while (input >> std::hex >> hash >> std::dec >> loop.entries >> loop.iterations >> loop.nodes >>
+         loop.entry_value >> loop.entry_value_count) {
+    Add(hash, loop);
+  }
+  CHECK(input.eof()) << "Malformed loop profile";
+  return true;
+}
+
+std::string SavedProfile::Serialize() const {
+  std::vector<std::pair<uint64_t, Loop>> loops(loops_.begin(), loops_.end());
+  std::sort(loops.begin(), loops.end(),
+            [](const auto& a, const auto& b) { return a.first < b.first; });
+  std::stringstream buffer;
+  buffer << Magic << " " << Version << "\n"
+         << "cell_bits " << cell_bits_ << "\n"
+         << "total_nodes " << total_nodes_ << "\n";
+  for (const auto& [hash, loop] : loops) {
+    buffer << std::hex << hash << std::dec << " " << loop.entries << " " << loop.iterations << " "
+           << loop.nodes << " " << loop.entry_value << " " << loop.entry_value_count << "\n";
+  }
+  return std::move(buffer).str();
+}
+
+void SavedProfile::Add(uint64_t hash, const Loop& loop) {
+  Loop& saved = loops_[hash];
+  saved.entries += loop.entries;
+  saved.iterations += loop.iterations;
+  saved.nodes += loop.nodes;
+  if (saved.entry_value == loop.entry_value) {
+    saved.entry_value_count += loop.entry_value_count;
+  } else if (saved.entry_value_count < loop.entry_value_count) {
+    saved.entry_value = loop.entry_value;
+    saved.entry_value_count = loop.entry_value_count;
+  }
+}
+
+const SavedProfile::Loop* SavedProfile::Find(uint64_t hash) const {
+  auto iter = loops_.find(hash);
+  return iter == loops_.end() ? nullptr : &iter->second;
+}
+
+int ApplyProfile(ast::Tree* tree, const SavedProfile& profile, int cell_bits) {
+  const absl::flat_hash_map<const ast::Loop*, uint64_t> hashes = HashLoops(*tree);
+  std::vector<ast::Loop*> loops;
+  CollectLoops(tree, &loops);
+
+  std::vector<std::pair<ast::Loop*, const SavedProfile::Loop*>> hot;
+  for (ast::Loop* loop : loops) {
+    const SavedProfile::Loop* counts = profile.Find(hashes.at(loop));
+    if (counts != nullptr && counts->nodes > 0 &&
+        counts->nodes * 100 >= profile.total_nodes() * HotPercent) {
+      hot.emplace_back(loop, counts);
+    }
+  }
+  std::stable_sort(hot.begin(), hot.end(),
+                   [](const auto& a, const auto& b) { return a.second->nodes > b.second->nodes; });
+
+  size_t budget = std::max(CountNodes(*tree) * GrowthPercent / 100, MinGrowth);
+  int rewrites = 0;
+  for (const auto& [loop, counts] : hot) {
+    const size_t body = std::max<size_t>(CountNodes(*loop), 1);
+    LoopHints hints;
+    // Entry values are only meaningful for cells of the same width.
+    if (profile.cell_bits() == cell_bits && counts->entry_value != 0 &&
+        counts->entry_value_count * 100 >= counts->entries * DominantPercent) {
+      const int trips = TripCount(*loop, counts->entry_value, cell_bits);
+      const size_t growth = trips * body;
+      if (trips > 0 && growth <= MaxSpecializedNodes && growth <= budget) {
+        hints.trip_count = trips;
+        hints.entry_value = WrapToCell(counts->entry_value, cell_bits);
+        budget -= growth;
+      }
+    }
+    if (counts->iterations >= counts->entries * MinTripsToUnroll) {
+      const int unroll = std::min<size_t>(LoopHints::MaxUnroll, MaxUnrolledNodes / body);
+      const size_t growth = (unroll - 1) * body;
+      if (unroll > 1 && growth <= budget) {
+        hints.unroll = unroll;
+        budget -= growth;
+      }
+    }
+    if (hints.unroll > 1 || hints.trip_count > 0) {
+      loop->set_hints(hints);
+      rewrites++;
+    }
+  }
+  return rewrites;
+}
+
+}  // namespace dev::spiralgerbil::bf
@@ -0,0 +1,70 @@
+#ifndef DEV_SPIRALGERBIL_BF_COMPILER_PGO_H_
+#define DEV_SPIRALGERBIL_BF_COMPILER_PGO_H_
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#include "absl/container/flat_hash_map.h"
+
+#include "bf/compiler/ast.h"
+
+namespace dev::spiralgerbil::bf {
+
+// A hash of the structure of each loop of `program`, which is the same from
+// one run to the next. Offsets are taken relative to the loop's own, and
+// source locations and hints are left out, so that a loop keeps its hash when
+// the program is edited anywhere outside of it.
+absl::flat_hash_map<const ast::Loop*, uint64_t> HashLoops(const ast::Tree& program);
+
+// Loop counts saved from an earlier run, keyed by the hashes of HashLoops.
+// Identical loops share a key, and their counts are summed.
+class SavedProfile {
+ public:
+  static constexpr int Version = 1;
+
+  struct Loop {
+    uint64_t entries = 0;
+    uint64_t iterations = 0;
+    // Nodes executed directly in the body, not counting nested loops.
+    uint64_t nodes = 0;
+    // The value the loop's cell most often had on entry, wrapped as by
+    // WrapToCell, and how many entries had it.
+    int entry_value = 0;
+    uint64_t entry_value_count = 0;
+  };
+
+  SavedProfile() = default;
+  explicit SavedProfile(int cell_bits) : cell_bits_(cell_bits) {}
+
+  // Parses the output of Serialize. Dies if `text` is malformed, and returns
+  // false, leaving the profile empty, if it was written by another version.
+  bool Parse(std::string_view text);
+  std::string Serialize() const;
+
+  void Add(uint64_t hash, const Loop& loop);
+  // Null if the loop never ran in the profiled run.
+  const Loop* Find(uint64_t hash) const;
+
+  // The width of the cells of the profiled run, which entry values are for.
+  int cell_bits() const { return cell_bits_; }
+  // Nodes executed in the whole run.
+  uint64_t total_nodes() const { return total_nodes_; }
+  void set_total_nodes(uint64_t nodes) { total_nodes_ = nodes; }
+
+ private:
+  int cell_bits_ = 0;
+  uint64_t total_nodes_ = 0;
+  absl::flat_hash_map<uint64_t, Loop> loops_;
+};
+
+// Runs after the other passes. Unrolls hot loops that run many times per
+// entry, and specializes hot loops that usually start from the same value and
+// then run a known number of times, within a budget on how much the program
+// may grow. Cold loops are left alone. Returns the number of loops given
+// hints.
+int ApplyProfile(ast::Tree* tree, const SavedProfile& profile, int cell_bits);
+
+}  // namespace dev::spiralgerbil::bf
+
+#endif  // DEV_SPIRALGERBIL_BF_COMPILER_PGO_H_
@@ -3,17 +3,20 @@
 
 #include <iterator>
 #include <memory>
+#include <new>
 #include <type_traits>
 #include <vector>
 
 #include "boost/iterator/indirect_iterator.hpp"
 
+#include "bf/compiler/arena.h"
+
 namespace dev::spiralgerbil::bf {
 
 template <typename T>
 class PolyList final {
  private:
-  using InnerData = std::vector<std::unique_ptr<T>>;
+  using InnerData = std::vector<std::unique_ptr<T>, ArenaAllocator<std::unique_ptr<T>>>;
 
  public:
   using value_type = T;
@@ -115,6 +118,13 @@ class PolyList final {
   void pop_back() { data_.pop_back(); }
   void swap(PolyList& other) { data_.swap(other.data_); }
 
+  // Empties the list without destroying the elements or releasing storage.
+  // Only for lists whose elements and storage all live in an arena that is
+  // about to be destroyed.
+  void abandon() {
+    new (&data_) InnerData(ArenaAllocator<std::unique_ptr<T>>(nullptr));
+  }
+
   template <typename V>
   [[nodiscard]] std::unique_ptr<V> remove(V* value) {
     static_assert(std::is_base_of_v<T, V>);
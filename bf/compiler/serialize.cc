@@ -0,0 +1,350 @@
+#include "bf/compiler/serialize.h"
+
+#include <cstddef>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+#include "glog/logging.h"
+
+#include "bf/compiler/cell.h"
+
+namespace dev::spiralgerbil::bf {
+namespace {
+
+static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__, "Records are read in place");
+static_assert(sizeof(FlatRecord) == 12);
+
+constexpr char Magic[8] = {'b', 'f', '-', 'a', 's', 't', '\n', '\0'};
+constexpr size_t LoopSlots = 4;
+
+uint32_t ReadWord(const char* data) {
+  uint32_t word;
+  std::memcpy(&word, data, sizeof(word));
+  return word;
+}
+
+class Writer {
+ public:
+  void Put(NodeType type, int32_t offset, int32_t operand) {
+    const FlatRecord record{static_cast<int32_t>(type), offset, operand};
+    data_.append(reinterpret_cast<const char*>(&record), sizeof(record));
+    size_++;
+  }
+
+  void PutList(const NodeList& nodes) {
+    for (const Node& node : nodes) {
+      const int32_t offset = node.offset();
+      switch (node.type()) {
+        case NodeType::Move:
+          Put(NodeType::Move, offset, static_cast<const ast::Move&>(node).distance());
+          break;
+        case NodeType::Add:
+          Put(NodeType::Add, offset, static_cast<const ast::Add&>(node).amount());
+          break;
+        case NodeType::Output:
+        case NodeType::Input:
+          Put(node.type(), offset, 0);
+          break;
+        case NodeType::Loop: {
+          const auto& loop = static_cast<const ast::Loop&>(node);
+          const size_t head = data_.size();
+          Put(NodeType::Loop, offset, 0);
+          Put(NodeType::Loop, loop.location().line, loop.location().column);
+          Put(NodeType::Loop, loop.hints().unroll, loop.hints().trip_count);
+          Put(NodeType::Loop, loop.hints().entry_value, 0);
+          const size_t body_begin = size_;
+          PutList(loop.children());
+          const int32_t body = size_ - body_begin;
+          std::memcpy(&data_[head + offsetof(FlatRecord, operand)], &body, sizeof(body));
+          break;
+        }
+        case NodeType::Set:
+          Put(NodeType::Set, offset, static_cast<const ast::Set&>(node).value());
+          break;
+        case NodeType::AddMul: {
+          const auto& addmul = static_cast<const ast::AddMul&>(node);
+          Put(NodeType::AddMul, offset, addmul.multiplier());
+          Put(NodeType::AddMul, addmul.source(), 0);
+          break;
+        }
+        case NodeType::Write: {
+          const auto& offsets = static_cast<const ast::Write&>(node).offsets();
+          Put(NodeType::Write, offset, offsets.size());
+          for (int write_offset : offsets) {
+            Put(NodeType::Write, write_offset, 0);
+          }
+          break;
+        }
+        case NodeType::Scan:
+          Put(NodeType::Scan, offset, static_cast<const ast::Scan&>(node).stride());
+          break;
+        default:
+          LOG(FATAL) << "Cannot serialize node: " << node.DebugString();
+      }
+    }
+  }
+
+  size_t size() const { return size_; }
+  std::string Finish() { return std::move(data_); }
+
+ private:
+  std::string data_;
+  size_t size_ = 0;
+};
+
+}  // namespace
+
+FlatRecord FlatProgram::record(size_t index) const {
+  FlatRecord record;
+  std::memcpy(&record, records_ + index * sizeof(FlatRecord), sizeof(record));
+  return record;
+}
+
+bool FlatProgram::InReach(int64_t cells) const {
+  const int64_t reach = MaxReachBytes / (cell_bits_ / 8);
+  return cells >= -reach && cells <= reach;
+}
+
+size_t FlatProgram::Slots(const FlatRecord& record) {
+  switch (static_cast<NodeType>(record.type)) {
+    case NodeType::AddMul:
+      return 2;
+    case NodeType::Write:
+      return size_t{1} + static_cast<uint32_t>(record.operand);
+    case NodeType::Loop:
+      return LoopSlots;
+    default:
+      return 1;
+  }
+}
+
+bool FlatProgram::Parse(std::string_view data) {
+  *this = FlatProgram();
+  if (data.size() < HeaderSize || std::memcmp(data.data(), Magic, sizeof(Magic)) != 0 ||
+      ReadWord(&data[8]) != Version || !IsValidCellBits(ReadWord(&data[12])) ||
+      ReadWord(&data[20]) != 0 || (data.size() - HeaderSize) % sizeof(FlatRecord) != 0 ||
+      (data.size() - HeaderSize) / sizeof(FlatRecord) != ReadWord(&data[16])) {
+    return false;
+  }
+  records_ = data.data() + HeaderSize;
+  size_ = ReadWord(&data[16]);
+  cell_bits_ = ReadWord(&data[12]);
+  // The pointer starts on the first cell.
+  int64_t pointer = 0;
+  if (!Validate(0, size_, &pointer)) {
+    *this = FlatProgram();
+    return false;
+  }
+  return true;
+}
+
+bool FlatProgram::Validate(size_t begin, size_t end, int64_t* pointer) const {
+  // Accesses `offset` from the pointer, which must be within reach of the cell
+  // accessed before. That one was on the tape, or the program faulted there.
+  auto access = [&](int32_t offset) { return InReach(*pointer + offset); };
+  for (size_t i = begin; i < end;) {
+    const FlatRecord head = record(i);
+    if (head.type <= static_cast<int32_t>(NodeType::Tree) ||
+        head.type > static_cast<int32_t>(NodeType::Scan)) {
+      return false;
+    }
+    // A negative Write count reads as billions of slots, and so fails the
+    // check.
+    const size_t slots = Slots(head);
+    if (slots > end - i) {
+      return false;
+    }
+    for (size_t slot = 1; slot < slots; slot++) {
+      if (record(i + slot).type != head.type) {
+        return false;
+      }
+    }
+    if (!InReach(head.offset)) {
+      return false;
+    }
+    switch (static_cast<NodeType>(head.type)) {
+      case NodeType::Move:
+        if (!InReach(head.operand)) {
+          return false;
+        }
+        *pointer += head.operand;
+        break;
+      case NodeType::Scan:
+        // Each step tests the cell it moved to.
+        if (!InReach(head.operand) || !access(0)) {
+          return false;
+        }
+        *pointer = 0;
+        break;
+      case NodeType::Add:
+      case NodeType::Output:
+      case NodeType::Input:
+      case NodeType::Set:
+        if (!access(head.offset)) {
+          return false;
+        }
+        *pointer = -head.offset;
+        break;
+      case NodeType::AddMul:
+        if (!access(head.offset) || !access(record(i + 1).offset)) {
+          return false;
+        }
+        *pointer = -head.offset;
+        break;
+      case NodeType::Write:
+        for (size_t slot = 1; slot < slots; slot++) {
+          if (!access(record(i + slot).offset)) {
+            return false;
+          }
+        }
+        if (slots > 1) {
+          *pointer = -record(i + 1).offset;
+        }
+        break;
+      case NodeType::Loop: {
+        const FlatRecord hints = record(i + 2);
+        const FlatRecord entry = record(i + 3);
+        const size_t body_begin = i + LoopSlots;
+        if (!access(head.offset) || hints.offset < 1 || hints.offset > LoopHints::MaxUnroll ||
+            hints.operand < 0 || hints.operand > LoopHints::MaxTripCount ||
+            (hints.operand == 0 && entry.offset != 0) || entry.operand != 0 ||
+            head.operand < 0 || static_cast<size_t>(head.operand) > end - body_begin) {
+          return false;
+        }
+        const size_t body_end = body_begin + head.operand;
+        // The test at the end of each trip is within reach of where the body
+        // left the pointer.
+        int64_t body_pointer = -head.offset;
+        if (!Validate(body_begin, body_end, &body_pointer) ||
+            !InReach(body_pointer + head.offset)) {
+          return false;
+        }
+        // Copies of the body for a trip count run with no tests in between.
+        if (hints.operand > 0 && !KeepsCounter(body_begin, body_end, head.offset, true)) {
+          return false;
+        }
+        *pointer = -head.offset;
+        i += head.operand;
+        break;
+      }
+      default:
+        break;
+    }
+    i += slots;
+  }
+  return true;
+}
+
+bool FlatProgram::KeepsCounter(size_t begin, size_t end, int32_t counter, bool top_level) const {
+  for (size_t i = begin; i < end;) {
+    const FlatRecord head = record(i);
+    switch (static_cast<NodeType>(head.type)) {
+      case NodeType::Move:
+      case NodeType::Scan:
+        return false;
+      case NodeType::Add:
+        if (head.offset == counter && !top_level) {
+          return false;
+        }
+        break;
+      case NodeType::Input:
+      case NodeType::Set:
+      case NodeType::AddMul:
+        if (head.offset == counter) {
+          return false;
+        }
+        break;
+      case NodeType::Loop:
+        if (!KeepsCounter(i + LoopSlots, i + LoopSlots + head.operand, counter, false)) {
+          return false;
+        }
+        i += head.operand;
+        break;
+      default:
+        break;
+    }
+    i += Slots(head);
+  }
+  return true;
+}
+
+NodeList FlatProgram::Build(size_t begin, size_t end) const {
+  NodeList nodes;
+  for (size_t i = begin; i < end;) {
+    const FlatRecord head = record(i);
+    switch (static_cast<NodeType>(head.type)) {
+      case NodeType::Move:
+        nodes.push_back(std::make_unique<ast::Move>(head.operand));
+        break;
+      case NodeType::Add:
+        nodes.push_back(std::make_unique<ast::Add>(head.operand, head.offset));
+        break;
+      case NodeType::Output:
+        nodes.push_back(std::make_unique<ast::Output>(head.offset));
+        break;
+      case NodeType::Input:
+        nodes.push_back(std::make_unique<ast::Input>(head.offset));
+        break;
+      case NodeType::Loop: {
+        const FlatRecord location = record(i + 1);
+        const FlatRecord hints = record(i + 2);
+        const FlatRecord entry = record(i + 3);
+        const size_t body_begin = i + LoopSlots;
+        auto loop = std::make_unique<ast::Loop>(Build(body_begin, body_begin + head.operand),
+                                                head.offset,
+                                                SourceLocation{location.offset, location.operand});
+        loop->set_hints({hints.offset, hints.operand, entry.offset});
+        nodes.push_back(std::move(loop));
+        i += head.operand;
+        break;
+      }
+      case NodeType::Set:
+        nodes.push_back(std::make_unique<ast::Set>(head.operand, head.offset));
+        break;
+      case NodeType::AddMul:
+        nodes.push_back(
+            std::make_unique<ast::AddMul>(head.offset, head.operand, record(i + 1).offset));
+        break;
+      case NodeType::Write: {
+        std::vector<int> offsets;
+        for (int32_t slot = 1; slot <= head.operand; slot++) {
+          offsets.push_back(record(i + slot).offset);
+        }
+        nodes.push_back(std::make_unique<ast::Write>(offsets));
+        break;
+      }
+      case NodeType::Scan:
+        nodes.push_back(std::make_unique<ast::Scan>(head.operand));
+        break;
+      default:
+        LOG(FATAL) << "Invalid record type: " << head.type;
+    }
+    i += Slots(head);
+  }
+  return nodes;
+}
+
+std::unique_ptr<ast::Tree> FlatProgram::ToTree() const {
+  auto arena = std::make_unique<Arena>();
+  NodeList program;
+  {
+    ArenaScope scope(arena.get());
+    program = Build(0, size_);
+  }
+  return std::make_unique<ast::Tree>(std::move(program), std::move(arena));
+}
+
+std::string Serialize(const ast::Tree& program, int cell_bits) {
+  Writer writer;
+  writer.PutList(program.children());
+  const uint32_t header[] = {FlatProgram::Version, static_cast<uint32_t>(cell_bits),
+                             static_cast<uint32_t>(writer.size()), 0};
+  static_assert(sizeof(Magic) + sizeof(header) == FlatProgram::HeaderSize);
+  std::string data(Magic, sizeof(Magic));
+  data.append(reinterpret_cast<const char*>(header), sizeof(header));
+  data.append(writer.Finish());
+  return data;
+}
+
+}  // namespace dev::spiralgerbil::bf
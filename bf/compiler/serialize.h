@@ -0,0 +1,94 @@
+#ifndef DEV_SPIRALGERBIL_BF_COMPILER_SERIALIZE_H_
+#define DEV_SPIRALGERBIL_BF_COMPILER_SERIALIZE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include "bf/compiler/ast.h"
+
+namespace dev::spiralgerbil::bf {
+
+// An optimized program as a flat little-endian stream, which can be used
+// straight from a mapped file:
+//
+//   header:  "bf-ast\n\0", u32 version, u32 cell bits, u32 record count,
+//            u32 zero
+//   records: i32 type, i32 offset, i32 operand
+//
+// There is one record per node, in preorder, with the NodeType and offset of
+// the node and an operand that depends on the type:
+//
+//   Move, Add, Set, Scan:  the distance, amount, value or stride.
+//   Output, Input:         zero.
+//   AddMul:                the multiplier. One more AddMul record follows,
+//                          with the source in its offset.
+//   Write:                 the number of cells. As many Write records follow,
+//                          with the offsets of the cells in their offsets.
+//   Loop:                  the number of records of the body. Three Loop
+//                          records come before the body, holding the line and
+//                          column, the unroll factor and trip count, and the
+//                          entry value, in their offsets and operands.
+//
+// The constants of the program are folded for the cell width in the header,
+// which it must run with. Every access is within MaxReachBytes of the one
+// before it, counting the moves in between, so that one off the tape faults.
+// Loop hints are within the limits of LoopHints, and only a loop whose body
+// keeps the pointer where it is and changes the loop's cell only by Adds
+// directly in it has a trip count, like the ones the profile-guided pass
+// gives one.
+struct FlatRecord {
+  int32_t type;
+  int32_t offset;
+  int32_t operand;
+};
+
+class FlatProgram {
+ public:
+  static constexpr int Version = 1;
+
+  // Bytes before the first record.
+  static constexpr size_t HeaderSize = 24;
+
+  // Checks the header and the structure of the records of `data`, which must
+  // outlive the program. Returns false if they are not valid.
+  bool Parse(std::string_view data);
+
+  int cell_bits() const { return cell_bits_; }
+  size_t size() const { return size_; }
+  FlatRecord record(size_t index) const;
+
+  // Number of records taken by the node starting at `record`, not counting
+  // the body of a loop.
+  static size_t Slots(const FlatRecord& record);
+
+  // Builds the nodes, for the engines that run trees.
+  std::unique_ptr<ast::Tree> ToTree() const;
+
+ private:
+  const char* records_ = nullptr;
+  size_t size_ = 0;
+  int cell_bits_ = 0;
+
+  // Whether an offset or move of `cells` stays within MaxReachBytes.
+  bool InReach(int64_t cells) const;
+  // Checks the records from `begin` to `end`, with the pointer starting
+  // `*pointer` cells from the last cell accessed, and leaves it there as of
+  // the end.
+  bool Validate(size_t begin, size_t end, int64_t* pointer) const;
+  // Whether the records from `begin` to `end` keep the pointer where it is
+  // and change the cell at `counter` only through Adds, which must be
+  // `top_level`.
+  bool KeepsCounter(size_t begin, size_t end, int32_t counter, bool top_level) const;
+  NodeList Build(size_t begin, size_t end) const;
+};
+
+// Writes `program`, optimized for cells of `cell_bits` bits, in the format
+// that FlatProgram reads.
+std::string Serialize(const ast::Tree& program, int cell_bits);
+
+}  // namespace dev::spiralgerbil::bf
+
+#endif  // DEV_SPIRALGERBIL_BF_COMPILER_SERIALIZE_H_
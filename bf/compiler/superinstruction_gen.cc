@@ -0,0 +1,250 @@
+// Chooses the superinstructions of the threaded interpreter. Runs each
+// program of the corpus on a small profiling interpreter to count how often
+// every run of straight-line instructions executes, then greedily picks the
+// n-grams that save the most dispatches and writes them as an X-macro
+// include:
+//
+//   superinstruction_gen <output.inc> <program.bf>...
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "glog/logging.h"
+
+#include "bf/compiler/bytecode.h"
+#include "bf/compiler/cell.h"
+#include "bf/compiler/optimizer.h"
+#include "bf/compiler/parser.h"
+#include "bf/compiler/pass_manager.h"
+
+namespace dev::spiralgerbil::bf {
+namespace {
+
+using bytecode::Instruction;
+using bytecode::OpCode;
+
+constexpr size_t MaxSuperinstructions = 16;
+constexpr size_t MinLength = 2;
+constexpr size_t MaxLength = 4;
+constexpr int64_t ProfileCells = 1 << 20;
+constexpr int64_t ProfileSteps = 200'000'000;
+
+// Instructions that fall through to the next one and never jump.
+bool IsFusable(OpCode op) {
+  switch (op) {
+    case OpCode::Move:
+    case OpCode::Add:
+    case OpCode::Output:
+    case OpCode::Input:
+    case OpCode::Set:
+    case OpCode::AddMul:
+    case OpCode::Scan:
+      return true;
+    default:
+      return false;
+  }
+}
+
+using Ngram = std::vector<OpCode>;
+
+// Executes `program` with 16-bit cells and no input for at most
+// `ProfileSteps` instructions, returning how often each one ran. The pointer
+// starts in the middle of the tape, as the pending offsets of a Move may
+// briefly take it left of the first cell, and programs that leave the tape
+// just stop early.
+std::vector<int64_t> Profile(const Bytecode& program) {
+  std::vector<int64_t> counts(program.size());
+  std::vector<uint16_t> tape(ProfileCells);
+  int64_t pointer = ProfileCells / 2;
+  auto in_bounds = [&](int64_t cell) { return cell >= 0 && cell < ProfileCells; };
+  size_t pc = 0;
+  for (int64_t step = 0; step < ProfileSteps; step++) {
+    const Instruction& inst = program[pc];
+    counts[pc]++;
+    const int64_t target = pointer + inst.offset;
+    if (!in_bounds(target)) {
+      break;
+    }
+    size_t next = pc + InstructionSlots(inst);
+    switch (inst.op) {
+      case OpCode::Move:
+        pointer += inst.arg;
+        break;
+      case OpCode::Add:
+        tape[target] += inst.arg;
+        break;
+      case OpCode::Input:
+        tape[target] = 0xFFFF;
+        break;
+      case OpCode::LoopBegin:
+        if (tape[target] == 0) {
+          next = inst.arg + 1;
+        }
+        break;
+      case OpCode::LoopEnd:
+        if (tape[target] != 0) {
+          next = inst.arg + 1;
+        }
+        break;
+      case OpCode::Set:
+        tape[target] = inst.arg;
+        break;
+      case OpCode::AddMul: {
+        const int64_t source = pointer + program[pc + 1].offset;
+        if (!in_bounds(source)) {
+          return counts;
+        }
+        tape[target] += tape[source] * static_cast<uint16_t>(inst.arg);
+        break;
+      }
+      case OpCode::Scan:
+        while (in_bounds(pointer) && tape[pointer] != 0) {
+          pointer += inst.arg;
+        }
+        break;
+      case OpCode::Halt:
+        return counts;
+      default:
+        break;
+    }
+    if (!in_bounds(pointer)) {
+      break;
+    }
+    pc = next;
+  }
+  return counts;
+}
+
+// Adds each maximal run of fusable instructions in `program`, weighted by
+// how often it executed, to `runs`.
+void CollectRuns(const Bytecode& program, const std::vector<int64_t>& counts,
+                 std::map<Ngram, int64_t>* runs) {
+  Ngram run;
+  int64_t weight = 0;
+  for (size_t i = 0; i < program.size(); i += InstructionSlots(program[i])) {
+    if (IsFusable(program[i].op)) {
+      if (run.empty()) {
+        weight = counts[i];
+      }
+      run.push_back(program[i].op);
+      continue;
+    }
+    if (run.size() >= MinLength && weight > 0) {
+      (*runs)[run] += weight;
+    }
+    run.clear();
+  }
+}
+
+// Dispatches saved on `run` by fusing greedily with the longest match, as
+// the threaded interpreter does.
+int64_t Savings(const Ngram& run, const std::vector<Ngram>& chosen) {
+  int64_t saved = 0;
+  for (size_t i = 0; i < run.size();) {
+    size_t longest = 1;
+    for (const Ngram& ngram : chosen) {
+      if (ngram.size() > longest && i + ngram.size() <= run.size() &&
+          std::equal(ngram.begin(), ngram.end(), run.begin() + i)) {
+        longest = ngram.size();
+      }
+    }
+    saved += longest - 1;
+    i += longest;
+  }
+  return saved;
+}
+
+int64_t TotalSavings(const std::map<Ngram, int64_t>& runs, const std::vector<Ngram>& chosen) {
+  int64_t total = 0;
+  for (const auto& [run, weight] : runs) {
+    total += weight * Savings(run, chosen);
+  }
+  return total;
+}
+
+std::string Name(const Ngram& ngram) {
+  std::string name;
+  for (OpCode op : ngram) {
+    name += OpCodeName(op);
+  }
+  return name;
+}
+
+}  // namespace
+}  // namespace dev::spiralgerbil::bf
+
+int main(int argc, char** argv) {
+  using namespace dev::spiralgerbil::bf;
+  google::InitGoogleLogging(argv[0]);
+  CHECK_GE(argc, 2) << "Usage: " << argv[0] << " <output.inc> <program.bf>...";
+
+  std::map<Ngram, int64_t> runs;
+  for (int i = 2; i < argc; i++) {
+    std::ifstream input(argv[i]);
+    CHECK(input) << "Could not open " << argv[i];
+    std::unique_ptr<ast::Tree> program = Parse(&input);
+    // Profiling runs without input, which is exactly the part of a program
+    // that partial evaluation would take out.
+    PassManager pass_manager;
+    AddDefaultPasses(&pass_manager, DefaultCellBits, /*profile=*/nullptr,
+                     /*partial_eval_budget=*/0);
+    pass_manager.Run(program.get());
+    const Bytecode bytecode = LowerToBytecode(*program);
+    CollectRuns(bytecode, Profile(bytecode), &runs);
+  }
+
+  std::set<Ngram> candidates;
+  for (const auto& [run, weight] : runs) {
+    for (size_t begin = 0; begin < run.size(); begin++) {
+      for (size_t length = MinLength; length <= MaxLength && begin + length <= run.size(); length++) {
+        candidates.emplace(run.begin() + begin, run.begin() + begin + length);
+      }
+    }
+  }
+
+  // Candidates overlap, so each is scored by what it adds to those already
+  // chosen.
+  std::vector<Ngram> chosen;
+  std::vector<int64_t> scores;
+  int64_t total = 0;
+  while (chosen.size() < MaxSuperinstructions) {
+    const Ngram* best = nullptr;
+    int64_t best_total = total;
+    for (const Ngram& candidate : candidates) {
+      chosen.push_back(candidate);
+      const int64_t candidate_total = TotalSavings(runs, chosen);
+      chosen.pop_back();
+      if (candidate_total > best_total) {
+        best = &candidate;
+        best_total = candidate_total;
+      }
+    }
+    if (best == nullptr) {
+      break;
+    }
+    chosen.push_back(*best);
+    scores.push_back(best_total - total);
+    total = best_total;
+    candidates.erase(*best);
+  }
+
+  std::ofstream output(argv[1]);
+  CHECK(output) << "Could not open " << argv[1];
+  output << "// Generated by //bf/compiler:superinstruction_gen from " << argc - 2
+         << " programs. Do not edit.\n";
+  for (size_t i = 0; i < chosen.size(); i++) {
+    output << "BF_SUPERINSTRUCTION(" << Name(chosen[i]) << ",";
+    for (OpCode op : chosen[i]) {
+      output << " BF_OP(" << OpCodeName(op) << ")";
+    }
+    output << ")  // saves " << scores[i] << " dispatches\n";
+  }
+  return 0;
+}
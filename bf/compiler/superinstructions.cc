@@ -0,0 +1,48 @@
+#include "bf/compiler/superinstructions.h"
+
+#include <vector>
+
+namespace dev::spiralgerbil::bf {
+namespace bytecode {
+namespace {
+
+// Indexed by Superinstruction, with an empty pattern for None.
+const std::vector<OpCode> Patterns[] = {
+#define BF_OP(op) OpCode::op,
+#define BF_SUPERINSTRUCTION(name, ops) {ops},
+#include "bf/compiler/superinstructions.inc"
+#undef BF_SUPERINSTRUCTION
+#undef BF_OP
+  {},
+};
+
+}  // namespace
+
+Superinstruction MatchSuperinstruction(const Bytecode& program, size_t index, size_t* slots) {
+  Superinstruction best = Superinstruction::None;
+  size_t best_length = 0;
+  for (int i = 0; i < static_cast<int>(Superinstruction::None); i++) {
+    const auto& pattern = Patterns[i];
+    if (pattern.size() <= best_length) {
+      continue;
+    }
+    size_t position = index;
+    bool matches = true;
+    for (OpCode op : pattern) {
+      if (position >= program.size() || program[position].op != op) {
+        matches = false;
+        break;
+      }
+      position += InstructionSlots(program[position]);
+    }
+    if (matches) {
+      best = static_cast<Superinstruction>(i);
+      best_length = pattern.size();
+      *slots = position - index;
+    }
+  }
+  return best;
+}
+
+}  // namespace bytecode
+}  // namespace dev::spiralgerbil::bf
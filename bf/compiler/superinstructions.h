@@ -0,0 +1,31 @@
+#ifndef DEV_SPIRALGERBIL_BF_COMPILER_SUPERINSTRUCTIONS_H_
+#define DEV_SPIRALGERBIL_BF_COMPILER_SUPERINSTRUCTIONS_H_
+
+#include <cstddef>
+#include <cstdint>
+
+#include "bf/compiler/bytecode.h"
+
+namespace dev::spiralgerbil::bf {
+namespace bytecode {
+
+// Runs of straight-line instructions that the threaded interpreter executes
+// with a single dispatch. The set is chosen at build time by
+// superinstruction_gen from the n-grams that are most frequent in the test
+// corpus. Each is listed in superinstructions.inc as
+// BF_SUPERINSTRUCTION(name, BF_OP(op) ...).
+enum class Superinstruction : uint8_t {
+#define BF_SUPERINSTRUCTION(name, ops) name,
+#include "bf/compiler/superinstructions.inc"
+#undef BF_SUPERINSTRUCTION
+  None,
+};
+
+// Returns the longest superinstruction that starts at `program[index]` and
+// sets `*slots` to the number of slots it spans, or returns None.
+Superinstruction MatchSuperinstruction(const Bytecode& program, size_t index, size_t* slots);
+
+}  // namespace bytecode
+}  // namespace dev::spiralgerbil::bf
+
+#endif  // DEV_SPIRALGERBIL_BF_COMPILER_SUPERINSTRUCTIONS_H_
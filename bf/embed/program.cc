@@ -0,0 +1,133 @@
+#include "bf/embed/program.h"
+
+#include "glog/logging.h"
+
+#include "bf/compiler/optimizer.h"
+#include "bf/compiler/parser.h"
+#include "bf/compiler/serialize.h"
+#include "bf/interpreter/context.h"
+#include "bf/interpreter/interp_bytecode.h"
+#include "bf/interpreter/tape.h"
+
+namespace dev::spiralgerbil::bf {
+
+std::unique_ptr<const Program> Program::Compile(std::string_view source,
+                                                const ProgramOptions& options,
+                                                std::string* error) {
+  CHECK(IsValidCellBits(options.cell_bits)) << "Unsupported cell width: " << options.cell_bits;
+  std::unique_ptr<ast::Tree> tree = Parse(source, error);
+  if (tree == nullptr) {
+    return nullptr;
+  }
+  PassManager pass_manager(options.optimizer_iterations);
+  AddDefaultPasses(&pass_manager, options.cell_bits, /*profile=*/nullptr,
+                   options.partial_eval_budget);
+  pass_manager.Run(tree.get());
+  return std::unique_ptr<const Program>(
+      new Program(LowerToBytecode(*tree), options.cell_bits, options.eof));
+}
+
+std::unique_ptr<const Program> Program::Load(std::string_view data, EofBehavior eof,
+                                             std::string* error) {
+  FlatProgram flat;
+  if (!flat.Parse(data)) {
+    *error = "Not a program written by Serialize, or by another version of it";
+    return nullptr;
+  }
+  return std::unique_ptr<const Program>(new Program(LowerToBytecode(flat), flat.cell_bits(), eof));
+}
+
+// The state that depends on the cell type, chosen once when the execution is
+// created.
+class Execution::Engine {
+ public:
+  virtual ~Engine() = default;
+  virtual Tape* tape() = 0;
+  // As InterpBytecodeLimited.
+  virtual bool Run(const Bytecode& bytecode, uint64_t* fuel, size_t* pc) = 0;
+};
+
+template <typename Cell, EofBehavior Eof>
+class Execution::EngineFor final : public Execution::Engine {
+ public:
+  EngineFor(OutputBuffer* output, InputBuffer* input, size_t tape_cells)
+      : context_(output, input, tape_cells) {}
+  EngineFor(OutputBuffer* output, InputBuffer* input, Tape* tape)
+      : context_(output, input, tape) {}
+
+  Tape* tape() override { return &context_.memory; }
+
+  bool Run(const Bytecode& bytecode, uint64_t* fuel, size_t* pc) override {
+    if (*fuel == ExecutionOptions::Unlimited && *pc == 0) {
+      InterpBytecode<Cell, Eof>(bytecode, &context_);
+      return true;
+    }
+    return InterpBytecodeLimited<Cell, Eof>(bytecode, &context_, fuel, pc);
+  }
+
+ private:
+  Context<Cell> context_;
+};
+
+Execution::Execution(const Program* program, std::string_view input, absl::Span<char> output,
+                     const ExecutionOptions& options)
+    : program_(program), input_(input), output_(output), fuel_(options.fuel) {
+  Init(options);
+}
+
+Execution::Execution(const Program* program, std::string_view input, std::string* output,
+                     const ExecutionOptions& options)
+    : program_(program), input_(input), sink_(output), output_(output), fuel_(options.fuel) {
+  Init(options);
+}
+
+void Execution::Init(const ExecutionOptions& options) {
+  if (options.tape != nullptr) {
+    CHECK_EQ(options.tape->cell_size() * 8, program_->cell_bits()) << "Tape of the wrong width";
+    options.tape->Clear();
+  }
+  engine_ = DispatchCell(
+      program_->cell_bits(), program_->eof(), [&](auto cell, auto eof) -> std::unique_ptr<Engine> {
+        using Engine = EngineFor<typename decltype(cell)::type, decltype(eof)::value>;
+        if (options.tape != nullptr) {
+          return std::make_unique<Engine>(&output_, &input_, options.tape);
+        }
+        return std::make_unique<Engine>(&output_, &input_, options.tape_cells);
+      });
+}
+
+Execution::~Execution() = default;
+
+Execution::Status Execution::Run() {
+  CHECK(!done_) << "The execution already ended";
+  // Nothing the fault skips over needs cleaning up: the engines keep their
+  // state in the context, and only touch the tape inside Run.
+  bool finished = false;
+  const bool in_bounds = engine_->tape()->CatchFaults(
+      [&] { finished = engine_->Run(program_->bytecode(), &fuel_, &pc_); });
+  output_.Flush();
+  if (!in_bounds) {
+    done_ = true;
+    return Status::OutOfBounds;
+  }
+  done_ = finished;
+  return finished ? Status::Finished : Status::OutOfFuel;
+}
+
+void Execution::AddFuel(uint64_t fuel) {
+  fuel_ = fuel > ExecutionOptions::Unlimited - fuel_ ? ExecutionOptions::Unlimited : fuel_ + fuel;
+}
+
+std::string_view ExecutionStatusName(Execution::Status status) {
+  switch (status) {
+    case Execution::Status::Finished:
+      return "finished";
+    case Execution::Status::OutOfFuel:
+      return "out of fuel";
+    case Execution::Status::OutOfBounds:
+      return "out of bounds";
+  }
+  LOG(FATAL) << "Unknown execution status";
+}
+
+}  // namespace dev::spiralgerbil::bf
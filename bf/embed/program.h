@@ -0,0 +1,144 @@
+#ifndef DEV_SPIRALGERBIL_BF_EMBED_PROGRAM_H_
+#define DEV_SPIRALGERBIL_BF_EMBED_PROGRAM_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#include "absl/types/span.h"
+
+#include "bf/compiler/bytecode.h"
+#include "bf/compiler/cell.h"
+#include "bf/compiler/partial_eval.h"
+#include "bf/compiler/pass_manager.h"
+#include "bf/interpreter/io.h"
+#include "bf/interpreter/tape.h"
+
+namespace dev::spiralgerbil::bf {
+
+struct ProgramOptions {
+  int cell_bits = DefaultCellBits;
+  EofBehavior eof = EofBehavior::MinusOne;
+  int optimizer_iterations = PassManager::DefaultMaxIterations;
+  // Zero turns off running the program up to its first input while compiling.
+  int64_t partial_eval_budget = DefaultPartialEvalBudget;
+};
+
+// A program compiled once for any number of Executions, which may run it at
+// the same time on any threads. It never changes after it is created.
+class Program {
+ public:
+  // Returns null, with the reason in `*error`, if `source` has unmatched
+  // brackets.
+  static std::unique_ptr<const Program> Compile(std::string_view source,
+                                                const ProgramOptions& options,
+                                                std::string* error);
+  // Loads a program written by Serialize, such as by --emit=bin, which runs
+  // with the cell width it was optimized for. Returns null, with the reason
+  // in `*error`, if `data` is not such a program.
+  static std::unique_ptr<const Program> Load(std::string_view data, EofBehavior eof,
+                                             std::string* error);
+
+  Program(const Program&) = delete;
+  Program& operator=(const Program&) = delete;
+
+  int cell_bits() const { return cell_bits_; }
+  EofBehavior eof() const { return eof_; }
+  const Bytecode& bytecode() const { return bytecode_; }
+
+ private:
+  Program(Bytecode bytecode, int cell_bits, EofBehavior eof)
+      : bytecode_(std::move(bytecode)), cell_bits_(cell_bits), eof_(eof) {}
+
+  const Bytecode bytecode_;
+  const int cell_bits_;
+  const EofBehavior eof_;
+};
+
+struct ExecutionOptions {
+  static constexpr uint64_t Unlimited = std::numeric_limits<uint64_t>::max();
+
+  // How much the program may run before Run returns OutOfFuel, as charged by
+  // InterpBytecodeLimited: each loop iteration costs the instructions in its
+  // body.
+  uint64_t fuel = Unlimited;
+  // Only the pages that are touched use memory.
+  size_t tape_cells = size_t{1} << 20;
+  // If set, the execution runs on this tape instead of creating one, so that
+  // a thread can reuse one tape for many executions. It is cleared first, and
+  // must have been created for cells of the program's width.
+  Tape* tape = nullptr;
+};
+
+// One run of a Program, with its own tape, reading its input from memory and
+// writing its output to memory. Beyond setting up a signal stack the first
+// time a thread runs any execution, it makes no system calls after it is
+// created, and shares nothing with other executions but the program, so
+// executions need no locking as long as each is used by one thread at a time.
+class Execution {
+ public:
+  enum class Status {
+    Finished,
+    // The program ran out of fuel. It runs on from where it stopped when
+    // given more.
+    OutOfFuel,
+    // The program moved off the tape and accessed a cell there.
+    OutOfBounds,
+  };
+
+  // `program`, `input` and `output` must outlive the execution. Output that
+  // does not fit in `output` is dropped.
+  Execution(const Program* program, std::string_view input, absl::Span<char> output,
+            const ExecutionOptions& options = {});
+  // Appends all of the output to `*output` instead, which must outlive the
+  // execution.
+  Execution(const Program* program, std::string_view input, std::string* output,
+            const ExecutionOptions& options = {});
+  ~Execution();
+
+  Execution(const Execution&) = delete;
+  Execution& operator=(const Execution&) = delete;
+
+  // Runs the program until it finishes, runs out of fuel or leaves the tape.
+  // After OutOfFuel, the tape, pointer, position and input and output are
+  // all kept, and Run may be called again, on any thread, once AddFuel has
+  // given it more. Running a program in many slices produces the same output
+  // as running it in one, so a few threads can take turns at many
+  // executions.
+  Status Run();
+
+  void AddFuel(uint64_t fuel);
+
+  // Bytes of output written to `output`, and dropped because it was full.
+  size_t output_size() const { return sink_ != nullptr ? sink_->size() : output_.memory_size(); }
+  size_t output_dropped() const { return output_.dropped(); }
+  // Fuel the program has not used.
+  uint64_t fuel() const { return fuel_; }
+
+ private:
+  class Engine;
+  template <typename Cell, EofBehavior Eof>
+  class EngineFor;
+
+  const Program* const program_;
+  InputBuffer input_;
+  std::string* const sink_ = nullptr;
+  OutputBuffer output_;
+  uint64_t fuel_;
+  // Where to resume after running out of fuel.
+  size_t pc_ = 0;
+  bool done_ = false;
+  std::unique_ptr<Engine> engine_;
+
+  void Init(const ExecutionOptions& options);
+};
+
+std::string_view ExecutionStatusName(Execution::Status status);
+
+}  // namespace dev::spiralgerbil::bf
+
+#endif  // DEV_SPIRALGERBIL_BF_EMBED_PROGRAM_H_
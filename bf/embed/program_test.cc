@@ -0,0 +1,151 @@
+// Runs programs through the embedding API. Exits nonzero on the first
+// failure.
+#include <atomic>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "absl/types/span.h"
+#include "glog/logging.h"
+
+#include "bf/embed/program.h"
+
+namespace dev::spiralgerbil::bf {
+namespace {
+
+// Prints "Hi".
+constexpr char Hi[] = "++++++++[>+++++++++<-]>.<+++++[>++++++<-]>+++.";
+// Moves off the left end of the tape.
+constexpr char OffTheTape[] = "+[<+]";
+
+std::unique_ptr<const Program> MustCompile(std::string_view source,
+                                           const ProgramOptions& options = {}) {
+  std::string error;
+  std::unique_ptr<const Program> program = Program::Compile(source, options, &error);
+  CHECK(program != nullptr) << error;
+  return program;
+}
+
+void TestCompileErrors() {
+  std::string error;
+  CHECK(Program::Compile("[[]\n]]", {}, &error) == nullptr);
+  CHECK_EQ(error, "Unmatched ] at 2:2");
+  CHECK(Program::Compile("+\n [[]", {}, &error) == nullptr);
+  CHECK_EQ(error, "Unmatched [ at 2:2");
+}
+
+void TestRun() {
+  const auto program = MustCompile(Hi);
+  std::string output;
+  Execution execution(program.get(), "", &output);
+  CHECK(execution.Run() == Execution::Status::Finished);
+  CHECK_EQ(output, "Hi");
+
+  // Output that does not fit is dropped.
+  char buffer[1];
+  Execution small(program.get(), "", absl::MakeSpan(buffer));
+  CHECK(small.Run() == Execution::Status::Finished);
+  CHECK_EQ(small.output_size(), 1);
+  CHECK_EQ(small.output_dropped(), 1);
+  CHECK_EQ(buffer[0], 'H');
+
+  ProgramOptions options;
+  options.eof = EofBehavior::Zero;
+  const auto cat = MustCompile(",[.,]", options);
+  std::string echoed;
+  Execution echo(cat.get(), "hello", &echoed);
+  CHECK(echo.Run() == Execution::Status::Finished);
+  CHECK_EQ(echoed, "hello");
+}
+
+void TestFuel() {
+  const auto forever = MustCompile("+[>+<]");
+  ExecutionOptions options;
+  options.fuel = 1000;
+  std::string output;
+  Execution execution(forever.get(), "", &output, options);
+  CHECK(execution.Run() == Execution::Status::OutOfFuel);
+  execution.AddFuel(1000);
+  CHECK(execution.Run() == Execution::Status::OutOfFuel);
+
+  // Stopping and resuming over and over prints the same as one run. Loops
+  // that print are not optimized away, so each trip costs fuel.
+  ProgramOptions no_partial_eval;
+  no_partial_eval.partial_eval_budget = 0;
+  const auto program = MustCompile("++++++++[>++++++++<-]>+<+++[>.<-]", no_partial_eval);
+  options.fuel = 0;
+  std::string resumed;
+  Execution sliced(program.get(), "", &resumed, options);
+  int slices = 0;
+  while (sliced.Run() == Execution::Status::OutOfFuel) {
+    sliced.AddFuel(1);
+    slices++;
+  }
+  CHECK_GT(slices, 1);
+  CHECK_EQ(resumed, "AAA");
+}
+
+void TestOutOfBounds() {
+  const auto program = MustCompile(OffTheTape);
+  for (int i = 0; i < 3; i++) {
+    std::string output;
+    Execution execution(program.get(), "", &output);
+    CHECK(execution.Run() == Execution::Status::OutOfBounds);
+  }
+  // Other executions are unaffected.
+  TestRun();
+}
+
+void TestManyExecutions() {
+  // More than fit in one chunk of the tape registry.
+  constexpr int Live = 5000;
+  const auto program = MustCompile(OffTheTape);
+  ExecutionOptions options;
+  options.tape_cells = 1024;
+  std::vector<std::string> outputs(Live);
+  std::vector<std::unique_ptr<Execution>> executions;
+  for (int i = 0; i < Live; i++) {
+    executions.push_back(std::make_unique<Execution>(program.get(), "", &outputs[i], options));
+  }
+  for (auto& execution : executions) {
+    CHECK(execution->Run() == Execution::Status::OutOfBounds);
+  }
+  executions.clear();
+
+  const auto hi = MustCompile(Hi);
+  std::atomic<int> failures{0};
+  std::vector<std::thread> threads;
+  for (int thread = 0; thread < 8; thread++) {
+    threads.emplace_back([&] {
+      for (int i = 0; i < 50; i++) {
+        std::string output;
+        Execution off(program.get(), "", &output, options);
+        Execution on(hi.get(), "", &output, options);
+        if (off.Run() != Execution::Status::OutOfBounds ||
+            on.Run() != Execution::Status::Finished || output != "Hi") {
+          failures++;
+        }
+      }
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  CHECK_EQ(failures.load(), 0);
+}
+
+}  // namespace
+}  // namespace dev::spiralgerbil::bf
+
+int main(int argc, char** argv) {
+  using namespace dev::spiralgerbil::bf;
+  google::InitGoogleLogging(argv[0]);
+  TestCompileErrors();
+  TestRun();
+  TestFuel();
+  TestOutOfBounds();
+  TestManyExecutions();
+  return 0;
+}
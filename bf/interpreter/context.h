@@ -0,0 +1,63 @@
+#ifndef DEV_SPIRALGERBIL_BF_INTERPRETER_CONTEXT_H_
+#define DEV_SPIRALGERBIL_BF_INTERPRETER_CONTEXT_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+
+#include "bf/compiler/cell.h"
+#include "bf/interpreter/io.h"
+#include "bf/interpreter/tape.h"
+
+namespace dev::spiralgerbil::bf {
+
+// Execution state shared by all of the interpreter engines, for cells of type
+// `Cell`.
+template <typename Cell>
+struct Context {
+  static_assert(std::is_unsigned_v<Cell>, "Cells wrap around, so must be unsigned.");
+
+  // Null if the tape is borrowed.
+  std::unique_ptr<Tape> owned_memory;
+  Tape& memory;
+  Cell* mem_ptr;
+  OutputBuffer* output;
+  InputBuffer* input;
+
+  Context(OutputBuffer* output, InputBuffer* input, size_t tape_cells = Tape::DefaultCells)
+      : owned_memory(std::make_unique<Tape>(tape_cells, sizeof(Cell))),
+        memory(*owned_memory),
+        mem_ptr(memory.begin<Cell>()),
+        output(output),
+        input(input) {}
+
+  // Runs on `memory`, which must be cleared, was created for cells of this
+  // type, and outlives the context. Lets one tape serve many runs in turn.
+  Context(OutputBuffer* output, InputBuffer* input, Tape* memory)
+      : memory(*memory), mem_ptr(memory->begin<Cell>()), output(output), input(input) {}
+
+  // Reads the next input byte into `cell`.
+  template <EofBehavior Eof>
+  void Read(Cell* cell) {
+    const int value = input->Get();
+    if constexpr (Eof == EofBehavior::MinusOne) {
+      *cell = static_cast<Cell>(value);
+    } else if (value != InputBuffer::Eof) {
+      *cell = static_cast<Cell>(value);
+    } else if constexpr (Eof == EofBehavior::Zero) {
+      *cell = 0;
+    }
+  }
+};
+
+// `cell * multiplier` modulo the cell width. Narrow cells are promoted to int,
+// where the product could overflow, so multiply as unsigned.
+template <typename Cell>
+inline Cell MultiplyCell(Cell cell, int32_t multiplier) {
+  return static_cast<Cell>(static_cast<uint32_t>(cell) * static_cast<uint32_t>(multiplier));
+}
+
+}  // namespace dev::spiralgerbil::bf
+
+#endif  // DEV_SPIRALGERBIL_BF_INTERPRETER_CONTEXT_H_
@@ -1,26 +1,24 @@
 #include "bf/interpreter/interp_ast.h"
 
 #include <cassert>
-#include <cstdio>
-#include <vector>
 
 #include "absl/base/optimization.h"
 
+#include "bf/interpreter/context.h"
+#include "bf/interpreter/scan.h"
+
 namespace dev::spiralgerbil::bf {
 namespace {
 
-using MemType = uint16_t;
-constexpr int MemSize = 30000;
-
-struct Context {
-  std::vector<MemType> memory;
-  std::vector<MemType>::iterator mem_ptr;
-
-  Context() : memory(MemSize, 0), mem_ptr(memory.begin()) {}
-};
-
-void InterpAst_rec(const NodeContainer& container, Context* context) {
+// Profiling is a template parameter so that the unprofiled instantiation
+// carries none of its cost.
+template <typename Cell, EofBehavior Eof, bool Profiled>
+void InterpAst_rec(const NodeContainer& container, Context<Cell>* context, LoopProfile* profile,
+                   LoopProfile::Counts* counts) {
   for (const auto& node : container.children()) {
+    if constexpr (Profiled) {
+      counts->nodes++;
+    }
     const auto mem_target = context->mem_ptr + node.offset();
     switch (node.type()) {
       case NodeType::Move:
@@ -30,22 +28,43 @@ void InterpAst_rec(const NodeContainer& container, Context* context) {
         *mem_target += static_cast<const ast::Add&>(node).amount();
         break;
       case NodeType::Output:
-        std::putchar(*mem_target);
+        context->output->Put(*mem_target);
         break;
       case NodeType::Input:
-        *mem_target = std::getchar();
+        context->template Read<Eof>(mem_target);
         break;
-      case NodeType::Loop:
-        while (*context->mem_ptr) {
-          InterpAst_rec(static_cast<const ast::Loop&>(node), context);
+      case NodeType::Loop: {
+        const auto& loop = static_cast<const ast::Loop&>(node);
+        LoopProfile::Counts* loop_counts = nullptr;
+        if constexpr (Profiled) {
+          loop_counts = profile->ForLoop(loop);
+          loop_counts->Enter(context->mem_ptr[node.offset()]);
+        }
+        while (context->mem_ptr[node.offset()]) {
+          if constexpr (Profiled) {
+            loop_counts->iterations++;
+          }
+          InterpAst_rec<Cell, Eof, Profiled>(loop, context, profile, loop_counts);
         }
         break;
+      }
       case NodeType::Set:
         *mem_target = static_cast<const ast::Set&>(node).value();
         break;
       case NodeType::AddMul: {
         const ast::AddMul& addmul = static_cast<const ast::AddMul&>(node);
-        *mem_target += *context->mem_ptr * addmul.multiplier();
+        *mem_target += MultiplyCell(context->mem_ptr[addmul.source()], addmul.multiplier());
+        break;
+      }
+      case NodeType::Write:
+        for (int offset : static_cast<const ast::Write&>(node).offsets()) {
+          context->output->Put(context->mem_ptr[offset]);
+        }
+        break;
+      case NodeType::Scan: {
+        context->mem_ptr = ScanForZero(context->mem_ptr, static_cast<const ast::Scan&>(node).stride(),
+                                       context->memory.template begin<Cell>(),
+                                       context->memory.template end<Cell>());
         break;
       }
       default:
@@ -56,10 +75,21 @@ void InterpAst_rec(const NodeContainer& container, Context* context) {
 
 }  // namespace
 
-void InterpAst(const ast::Tree& program_ast) {
-  Context context;
-  InterpAst_rec(program_ast, &context);
+template <typename Cell, EofBehavior Eof>
+void InterpAst(const ast::Tree& program_ast, Context<Cell>* context) {
+  InterpAst_rec<Cell, Eof, false>(program_ast, context, nullptr, nullptr);
 }
 
+template <typename Cell, EofBehavior Eof>
+void InterpAstProfiled(const ast::Tree& program_ast, Context<Cell>* context, LoopProfile* profile) {
+  InterpAst_rec<Cell, Eof, true>(program_ast, context, profile, profile->program());
+}
+
+#define INSTANTIATE_INTERP_AST(Cell, Eof)                            \
+  template void InterpAst<Cell, Eof>(const ast::Tree&, Context<Cell>*); \
+  template void InterpAstProfiled<Cell, Eof>(const ast::Tree&, Context<Cell>*, LoopProfile*);
+BF_FOR_EACH_CELL_CONFIG(INSTANTIATE_INTERP_AST)
+#undef INSTANTIATE_INTERP_AST
+
 }  // namespace dev::spiralgerbil::bf
 
@@ -2,10 +2,20 @@
 #define DEV_SPIRALGERBIL_BF_INTERPRETER_INTERP_AST_H_
 
 #include "bf/compiler/ast.h"
+#include "bf/compiler/cell.h"
+#include "bf/interpreter/context.h"
+#include "bf/interpreter/profile.h"
 
 namespace dev::spiralgerbil::bf {
 
-void InterpAst(const ast::Tree& program_ast);
+// Instantiated for every cell type and EOF behavior.
+template <typename Cell, EofBehavior Eof>
+void InterpAst(const ast::Tree& program_ast, Context<Cell>* context);
+
+// Like InterpAst, but counts the entries, iterations and executed nodes of
+// each loop in `profile`, which must have been built for `program_ast`.
+template <typename Cell, EofBehavior Eof>
+void InterpAstProfiled(const ast::Tree& program_ast, Context<Cell>* context, LoopProfile* profile);
 
 }  // namespace dev::spiralgerbil::bf
 
@@ -0,0 +1,111 @@
+#include "bf/interpreter/interp_bytecode.h"
+
+#include "absl/base/optimization.h"
+
+#include "bf/interpreter/context.h"
+#include "bf/interpreter/scan.h"
+
+namespace dev::spiralgerbil::bf {
+namespace {
+
+using bytecode::Instruction;
+using bytecode::OpCode;
+
+// Limiting is a template parameter so that the unlimited instantiation
+// carries none of its cost. Starts at `*pc` and returns false, with the index
+// to resume from in `*pc`, if it stopped because `*fuel` ran out.
+template <typename Cell, EofBehavior Eof, bool Limited>
+bool Run(const Instruction* program, Context<Cell>* context, uint64_t* fuel, size_t* pc_index) {
+  // Keep the tape pointer and the fuel in locals so they can live in
+  // registers.
+  Cell* mem_ptr = context->mem_ptr;
+  uint64_t fuel_left = Limited ? *fuel : 0;
+  const Cell* const memory_begin = context->memory.template begin<Cell>();
+  const Cell* const memory_end = context->memory.template end<Cell>();
+  for (const Instruction* pc = program + (Limited ? *pc_index : 0);; ++pc) {
+    Cell* const mem_target = mem_ptr + pc->offset;
+    switch (pc->op) {
+      case OpCode::Move:
+        mem_ptr += pc->arg;
+        break;
+      case OpCode::Add:
+        *mem_target += pc->arg;
+        break;
+      case OpCode::Output:
+        context->output->Put(*mem_target);
+        break;
+      case OpCode::Input:
+        context->template Read<Eof>(mem_target);
+        break;
+      case OpCode::LoopBegin:
+        if (!*mem_target) {
+          pc = program + pc->arg;
+        }
+        break;
+      case OpCode::LoopEnd:
+        if (*mem_target) {
+          if constexpr (Limited) {
+            // The whole next iteration is paid for up front, at a cost of
+            // the instructions in the body.
+            const uint64_t cost = pc - (program + pc->arg);
+            if (cost > fuel_left) {
+              *fuel = fuel_left;
+              // Resuming tries this jump again, and pays for it then.
+              *pc_index = pc - program;
+              context->mem_ptr = mem_ptr;
+              return false;
+            }
+            fuel_left -= cost;
+          }
+          pc = program + pc->arg;
+        }
+        break;
+      case OpCode::Set:
+        *mem_target = pc->arg;
+        break;
+      case OpCode::AddMul:
+        *mem_target += MultiplyCell(mem_ptr[pc[1].offset], pc->arg);
+        ++pc;
+        break;
+      case OpCode::Write:
+        for (const Instruction* operand = pc + 1; operand <= pc + pc->arg; operand++) {
+          context->output->Put(mem_ptr[operand->offset]);
+        }
+        pc += pc->arg;
+        break;
+      case OpCode::Scan:
+        mem_ptr = ScanForZero(mem_ptr, pc->arg, memory_begin, memory_end);
+        break;
+      case OpCode::Halt:
+        if constexpr (Limited) {
+          *fuel = fuel_left;
+        }
+        context->mem_ptr = mem_ptr;
+        return true;
+      default:
+        ABSL_INTERNAL_ASSUME(false);
+    }
+  }
+}
+
+}  // namespace
+
+template <typename Cell, EofBehavior Eof>
+void InterpBytecode(const Bytecode& program, Context<Cell>* context) {
+  Run<Cell, Eof, false>(program.data(), context, nullptr, nullptr);
+}
+
+template <typename Cell, EofBehavior Eof>
+bool InterpBytecodeLimited(const Bytecode& program, Context<Cell>* context, uint64_t* fuel,
+                           size_t* pc) {
+  return Run<Cell, Eof, true>(program.data(), context, fuel, pc);
+}
+
+#define INSTANTIATE_INTERP_BYTECODE(Cell, Eof)                              \
+  template void InterpBytecode<Cell, Eof>(const Bytecode&, Context<Cell>*); \
+  template bool InterpBytecodeLimited<Cell, Eof>(const Bytecode&, Context<Cell>*, uint64_t*, \
+                                                 size_t*);
+BF_FOR_EACH_CELL_CONFIG(INSTANTIATE_INTERP_BYTECODE)
+#undef INSTANTIATE_INTERP_BYTECODE
+
+}  // namespace dev::spiralgerbil::bf
@@ -0,0 +1,31 @@
+#ifndef DEV_SPIRALGERBIL_BF_INTERPRETER_INTERP_BYTECODE_H_
+#define DEV_SPIRALGERBIL_BF_INTERPRETER_INTERP_BYTECODE_H_
+
+#include <cstddef>
+#include <cstdint>
+
+#include "bf/compiler/bytecode.h"
+#include "bf/compiler/cell.h"
+#include "bf/interpreter/context.h"
+
+namespace dev::spiralgerbil::bf {
+
+// Instantiated for every cell type and EOF behavior.
+template <typename Cell, EofBehavior Eof>
+void InterpBytecode(const Bytecode& program, Context<Cell>* context);
+
+// Like InterpBytecode, but limited to `*fuel`, and starting from the
+// instruction at index `*pc`. Fuel is only charged when a loop jumps back to
+// its start, for the instructions in its body, so straight-line code runs
+// without any checks. Returns true if the program finished, leaving the
+// unused fuel in `*fuel`. Returns false if the next iteration of a loop would
+// have cost more than is left. Everything the program needs to carry on is
+// then in `context` and `*pc`, so that calling again with more fuel resumes
+// it as if it had never stopped.
+template <typename Cell, EofBehavior Eof>
+bool InterpBytecodeLimited(const Bytecode& program, Context<Cell>* context, uint64_t* fuel,
+                           size_t* pc);
+
+}  // namespace dev::spiralgerbil::bf
+
+#endif  // DEV_SPIRALGERBIL_BF_INTERPRETER_INTERP_BYTECODE_H_
@@ -0,0 +1,203 @@
+#include "bf/interpreter/interp_threaded.h"
+
+#include <vector>
+
+#include "bf/compiler/superinstructions.h"
+#include "bf/interpreter/context.h"
+#include "bf/interpreter/scan.h"
+
+#if defined(__GNUC__) || defined(__clang__)
+#define BF_THREADED_DISPATCH 1
+#else
+#define BF_THREADED_DISPATCH 0
+#endif
+
+namespace dev::spiralgerbil::bf {
+namespace {
+
+using bytecode::Instruction;
+using bytecode::OpCode;
+using bytecode::Superinstruction;
+
+#if BF_THREADED_DISPATCH
+
+// An instruction with its opcode already resolved to a handler address.
+struct ThreadedInstruction {
+  const void* handler;
+  int32_t offset;
+  int32_t arg;
+};
+
+#define TARGET(op) op##_handler:
+#define DISPATCH() goto *pc->handler
+#define SUPERINSTRUCTION_TARGET(name) name##_superinstruction:
+
+#else
+
+using ThreadedInstruction = Instruction;
+
+#define TARGET(op) case OpCode::op:
+#define DISPATCH() continue
+
+#endif
+
+template <typename Cell, EofBehavior Eof>
+void Run(const Bytecode& bytecode, Context<Cell>* context) {
+#if BF_THREADED_DISPATCH
+  // Must match the order of bytecode::OpCode.
+  static const void* const handlers[] = {
+    &&Move_handler,
+    &&Add_handler,
+    &&Output_handler,
+    &&Input_handler,
+    &&LoopBegin_handler,
+    &&LoopEnd_handler,
+    &&Set_handler,
+    &&AddMul_handler,
+    &&Write_handler,
+    &&Scan_handler,
+    &&Halt_handler,
+  };
+  static_assert(sizeof(handlers) / sizeof(handlers[0]) == static_cast<int>(OpCode::Halt) + 1);
+  static const void* const superinstruction_handlers[] = {
+#define BF_SUPERINSTRUCTION(name, ops) &&name##_superinstruction,
+#include "bf/compiler/superinstructions.inc"
+#undef BF_SUPERINSTRUCTION
+    nullptr,
+  };
+
+  std::vector<ThreadedInstruction> threaded;
+  threaded.reserve(bytecode.size());
+  for (const Instruction& inst : bytecode) {
+    threaded.push_back({handlers[static_cast<int>(inst.op)], inst.offset, inst.arg});
+  }
+  // The instructions of a superinstruction keep their operands in place, so
+  // only the handler of the first one changes. Loops only jump to the
+  // instruction after a LoopBegin or LoopEnd, which never falls inside one.
+  for (size_t i = 0; i < bytecode.size();) {
+    size_t slots;
+    const Superinstruction superinstruction = MatchSuperinstruction(bytecode, i, &slots);
+    if (superinstruction == Superinstruction::None) {
+      i += InstructionSlots(bytecode[i]);
+    } else {
+      threaded[i].handler = superinstruction_handlers[static_cast<int>(superinstruction)];
+      i += slots;
+    }
+  }
+  const ThreadedInstruction* const program = threaded.data();
+#else
+  const ThreadedInstruction* const program = bytecode.data();
+#endif
+
+  Cell* mem_ptr = context->mem_ptr;
+  const Cell* const memory_begin = context->memory.template begin<Cell>();
+  const Cell* const memory_end = context->memory.template end<Cell>();
+  const ThreadedInstruction* pc = program;
+
+#if BF_THREADED_DISPATCH
+  DISPATCH();
+#else
+  for (;;) switch (pc->op) {
+#endif
+
+  // The straight-line instructions are written as steps so that the
+  // superinstructions can run several of them between dispatches.
+#define STEP_Move() \
+    mem_ptr += pc->arg; \
+    ++pc;
+#define STEP_Add() \
+    mem_ptr[pc->offset] += pc->arg; \
+    ++pc;
+#define STEP_Output() \
+    context->output->Put(mem_ptr[pc->offset]); \
+    ++pc;
+#define STEP_Input() \
+    context->template Read<Eof>(mem_ptr + pc->offset); \
+    ++pc;
+#define STEP_Set() \
+    mem_ptr[pc->offset] = pc->arg; \
+    ++pc;
+#define STEP_AddMul() \
+    mem_ptr[pc->offset] += MultiplyCell(mem_ptr[pc[1].offset], pc->arg); \
+    pc += 2;
+#define STEP_Scan() \
+    mem_ptr = ScanForZero(mem_ptr, pc->arg, memory_begin, memory_end); \
+    ++pc;
+
+  TARGET(Move)
+    STEP_Move()
+    DISPATCH();
+  TARGET(Add)
+    STEP_Add()
+    DISPATCH();
+  TARGET(Output)
+    STEP_Output()
+    DISPATCH();
+  TARGET(Input)
+    STEP_Input()
+    DISPATCH();
+  TARGET(LoopBegin)
+    pc = mem_ptr[pc->offset] ? pc + 1 : program + pc->arg + 1;
+    DISPATCH();
+  TARGET(LoopEnd)
+    pc = mem_ptr[pc->offset] ? program + pc->arg + 1 : pc + 1;
+    DISPATCH();
+  TARGET(Set)
+    STEP_Set()
+    DISPATCH();
+  TARGET(AddMul)
+    STEP_AddMul()
+    DISPATCH();
+  TARGET(Write)
+    for (const ThreadedInstruction* operand = pc + 1; operand <= pc + pc->arg; operand++) {
+      context->output->Put(mem_ptr[operand->offset]);
+    }
+    pc += pc->arg + 1;
+    DISPATCH();
+  TARGET(Scan)
+    STEP_Scan()
+    DISPATCH();
+  TARGET(Halt)
+    context->mem_ptr = mem_ptr;
+    return;
+
+#if BF_THREADED_DISPATCH
+#define BF_OP(op) STEP_##op()
+#define BF_SUPERINSTRUCTION(name, ops) \
+  SUPERINSTRUCTION_TARGET(name)        \
+    ops                                \
+    DISPATCH();
+#include "bf/compiler/superinstructions.inc"
+#undef BF_SUPERINSTRUCTION
+#undef BF_OP
+#endif
+
+#if !BF_THREADED_DISPATCH
+  }
+#endif
+}
+
+#undef STEP_Move
+#undef STEP_Add
+#undef STEP_Output
+#undef STEP_Input
+#undef STEP_Set
+#undef STEP_AddMul
+#undef STEP_Scan
+#undef TARGET
+#undef DISPATCH
+#undef SUPERINSTRUCTION_TARGET
+
+}  // namespace
+
+template <typename Cell, EofBehavior Eof>
+void InterpThreaded(const Bytecode& program, Context<Cell>* context) {
+  Run<Cell, Eof>(program, context);
+}
+
+#define INSTANTIATE_INTERP_THREADED(Cell, Eof) \
+  template void InterpThreaded<Cell, Eof>(const Bytecode&, Context<Cell>*);
+BF_FOR_EACH_CELL_CONFIG(INSTANTIATE_INTERP_THREADED)
+#undef INSTANTIATE_INTERP_THREADED
+
+}  // namespace dev::spiralgerbil::bf
@@ -0,0 +1,17 @@
+#ifndef DEV_SPIRALGERBIL_BF_INTERPRETER_INTERP_THREADED_H_
+#define DEV_SPIRALGERBIL_BF_INTERPRETER_INTERP_THREADED_H_
+
+#include "bf/compiler/bytecode.h"
+#include "bf/compiler/cell.h"
+#include "bf/interpreter/context.h"
+
+namespace dev::spiralgerbil::bf {
+
+// Runs `program` using direct-threaded dispatch where the compiler supports
+// labels-as-values, and a plain switch otherwise.
+template <typename Cell, EofBehavior Eof>
+void InterpThreaded(const Bytecode& program, Context<Cell>* context);
+
+}  // namespace dev::spiralgerbil::bf
+
+#endif  // DEV_SPIRALGERBIL_BF_INTERPRETER_INTERP_THREADED_H_
@@ -0,0 +1,229 @@
+#include "bf/interpreter/io.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+
+#include "glog/logging.h"
+
+namespace dev::spiralgerbil::bf {
+
+FlushPolicy DefaultFlushPolicy(int fd) {
+  return isatty(fd) ? FlushPolicy::Line : FlushPolicy::Input;
+}
+
+bool ParseFlushPolicy(std::string_view name, FlushPolicy* policy) {
+  if (name == "size") {
+    *policy = FlushPolicy::Size;
+  } else if (name == "input") {
+    *policy = FlushPolicy::Input;
+  } else if (name == "line") {
+    *policy = FlushPolicy::Line;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+OutputBuffer::OutputBuffer(int fd, FlushPolicy policy, size_t capacity)
+    : fd_(fd),
+      policy_(policy),
+      capacity_(capacity),
+      storage_(new char[capacity]),
+      buffer_(storage_.get()) {
+  CHECK(capacity > 0);
+}
+
+OutputBuffer::OutputBuffer(std::string* sink, size_t capacity)
+    : fd_(-1),
+      policy_(FlushPolicy::Size),
+      capacity_(capacity),
+      storage_(new char[capacity]),
+      buffer_(storage_.get()),
+      sink_(sink) {
+  CHECK(capacity > 0);
+}
+
+OutputBuffer::OutputBuffer(absl::Span<char> memory)
+    : fd_(-1), policy_(FlushPolicy::Size), capacity_(memory.size()), buffer_(memory.data()),
+      memory_(memory) {
+  if (memory.empty()) {
+    Flush();
+  }
+}
+
+OutputBuffer::~OutputBuffer() {
+  Flush();
+}
+
+void OutputBuffer::Flush() {
+  if (sink_ != nullptr) {
+    sink_->append(buffer_, size_);
+    flushed_ += size_;
+    size_ = 0;
+    return;
+  }
+  if (fd_ < 0) {
+    // Only the memory is kept; once it is full, Put goes on filling a small
+    // buffer that is thrown away.
+    if (buffer_ == memory_.data()) {
+      if (size_ < capacity_) {
+        return;
+      }
+      memory_size_ = size_;
+      storage_.reset(new char[OverflowCapacity]);
+      buffer_ = storage_.get();
+      capacity_ = OverflowCapacity;
+    } else {
+      dropped_ += size_;
+    }
+    flushed_ += size_;
+    size_ = 0;
+    return;
+  }
+  flushed_ += size_;
+  const char* data = buffer_;
+  while (size_ > 0) {
+    const ssize_t written = write(fd_, data, size_);
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      PLOG(ERROR) << "Could not write output";
+      break;
+    }
+    data += written;
+    size_ -= written;
+  }
+  size_ = 0;
+}
+
+MappedFile::MappedFile(const std::string& path) {
+  const int fd = open(path.c_str(), O_RDONLY);
+  PCHECK(fd >= 0) << "Could not open file: " << path;
+  PCHECK(Map(fd) || ReadAll(fd)) << "Could not read file: " << path;
+  close(fd);
+}
+
+std::unique_ptr<MappedFile> MappedFile::Open(const std::string& path, std::string* error) {
+  const int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    *error = "Could not open file: " + path + ": " + std::strerror(errno);
+    return nullptr;
+  }
+  std::unique_ptr<MappedFile> file(new MappedFile());
+  const bool read = file->Map(fd) || file->ReadAll(fd);
+  const int read_errno = errno;
+  close(fd);
+  if (!read) {
+    *error = "Could not read file: " + path + ": " + std::strerror(read_errno);
+    return nullptr;
+  }
+  return file;
+}
+
+MappedFile::MappedFile(int fd) {
+  PCHECK(Map(fd) || ReadAll(fd)) << "Could not read file";
+}
+
+MappedFile::~MappedFile() {
+  if (mapping_ != nullptr) {
+    munmap(mapping_, mapping_size_);
+  }
+}
+
+bool MappedFile::ReadAll(int fd) {
+  char chunk[64 * 1024];
+  for (;;) {
+    const ssize_t count = read(fd, chunk, sizeof(chunk));
+    if (count < 0 && errno == EINTR) {
+      continue;
+    }
+    if (count < 0) {
+      return false;
+    }
+    if (count == 0) {
+      break;
+    }
+    read_buffer_.append(chunk, count);
+  }
+  contents_ = read_buffer_;
+  return true;
+}
+
+bool MappedFile::Map(int fd) {
+  struct stat info;
+  if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode)) {
+    return false;
+  }
+  const off_t start = lseek(fd, 0, SEEK_CUR);
+  if (start < 0 || start > info.st_size) {
+    return false;
+  }
+  if (start == info.st_size) {
+    contents_ = {};
+    return true;
+  }
+  void* mapping = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (mapping == MAP_FAILED) {
+    return false;
+  }
+  madvise(mapping, info.st_size, MADV_SEQUENTIAL);
+  mapping_ = mapping;
+  mapping_size_ = info.st_size;
+  contents_ = std::string_view(static_cast<const char*>(mapping) + start, info.st_size - start);
+  return true;
+}
+
+InputBuffer::InputBuffer(int fd, size_t capacity) : fd_(fd), capacity_(capacity) {
+  CHECK(capacity > 0);
+  struct stat info;
+  if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode)) {
+    mapping_ = std::make_unique<MappedFile>(fd);
+    pos_ = mapping_->contents().data();
+    end_ = pos_ + mapping_->contents().size();
+    read_ = mapping_->contents().size();
+  } else {
+    buffer_.reset(new char[capacity]);
+  }
+}
+
+InputBuffer::InputBuffer(std::string_view contents)
+    : fd_(-1),
+      capacity_(0),
+      pos_(contents.data()),
+      end_(contents.data() + contents.size()),
+      read_(contents.size()) {}
+
+InputBuffer::~InputBuffer() = default;
+
+int InputBuffer::Refill() {
+  if (buffer_ == nullptr) {
+    return Eof;
+  }
+  if (tied_output_ != nullptr) {
+    tied_output_->BeforeInput();
+  }
+  for (;;) {
+    const ssize_t count = read(fd_, buffer_.get(), capacity_);
+    if (count < 0 && errno == EINTR) {
+      continue;
+    }
+    if (count < 0) {
+      PLOG(ERROR) << "Could not read input";
+    }
+    if (count <= 0) {
+      return Eof;
+    }
+    pos_ = buffer_.get();
+    end_ = pos_ + count;
+    read_ += count;
+    return static_cast<unsigned char>(*pos_++);
+  }
+}
+
+}  // namespace dev::spiralgerbil::bf
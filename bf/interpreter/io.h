@@ -0,0 +1,165 @@
+#ifndef DEV_SPIRALGERBIL_BF_INTERPRETER_IO_H_
+#define DEV_SPIRALGERBIL_BF_INTERPRETER_IO_H_
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include "absl/types/span.h"
+
+namespace dev::spiralgerbil::bf {
+
+// When buffered output is written out, in addition to whenever the buffer
+// fills up and when it is destroyed.
+enum class FlushPolicy {
+  // Only when full.
+  Size,
+  // Also before the program waits for input, so prompts are visible.
+  Input,
+  // Also after every newline, as a terminal expects.
+  Line,
+};
+
+// Line for terminals, Input otherwise.
+FlushPolicy DefaultFlushPolicy(int fd);
+
+bool ParseFlushPolicy(std::string_view name, FlushPolicy* policy);
+
+// Collects program output and hands it to the kernel in large write(2) calls,
+// or keeps it in memory.
+class OutputBuffer {
+ public:
+  static constexpr size_t DefaultCapacity = 64 * 1024;
+
+  explicit OutputBuffer(int fd, FlushPolicy policy, size_t capacity = DefaultCapacity);
+  // Writes into `memory`, which must outlive the buffer, and never makes a
+  // system call. Output that does not fit is counted and dropped.
+  explicit OutputBuffer(absl::Span<char> memory);
+  // Appends all of the output to `*sink`, which must outlive the buffer.
+  explicit OutputBuffer(std::string* sink, size_t capacity = DefaultCapacity);
+  ~OutputBuffer();
+
+  OutputBuffer(const OutputBuffer&) = delete;
+  OutputBuffer& operator=(const OutputBuffer&) = delete;
+
+  void Put(char c) {
+    buffer_[size_++] = c;
+    if (size_ == capacity_ || (policy_ == FlushPolicy::Line && c == '\n')) {
+      Flush();
+    }
+  }
+
+  // Called before blocking on program input.
+  void BeforeInput() {
+    if (policy_ != FlushPolicy::Size) {
+      Flush();
+    }
+  }
+
+  void Flush();
+
+  // Bytes put so far.
+  uint64_t position() const { return flushed_ + size_; }
+
+  // For output to a span: the bytes written to it, and those dropped.
+  size_t memory_size() const { return buffer_ == memory_.data() ? size_ : memory_size_; }
+  size_t dropped() const { return dropped_ + (buffer_ == memory_.data() ? 0 : size_); }
+
+ private:
+  // Where memory output goes once the memory is full.
+  static constexpr size_t OverflowCapacity = 4096;
+
+  const int fd_;
+  const FlushPolicy policy_;
+  size_t capacity_;
+  std::unique_ptr<char[]> storage_;
+  char* buffer_;
+  size_t size_ = 0;
+  uint64_t flushed_ = 0;
+  std::string* const sink_ = nullptr;
+  absl::Span<char> memory_;
+  size_t memory_size_ = 0;
+  size_t dropped_ = 0;
+};
+
+// A read-only view of the remaining contents of a file. Regular files are
+// mapped into memory; anything else is read in full.
+class MappedFile {
+ public:
+  // Dies if the file cannot be opened.
+  explicit MappedFile(const std::string& path);
+  // Returns null, with the reason in `*error`, if the file cannot be opened or
+  // read, such as when it is a directory.
+  static std::unique_ptr<MappedFile> Open(const std::string& path, std::string* error);
+  // Maps or reads `fd` from its current position. Does not take ownership.
+  explicit MappedFile(int fd);
+  ~MappedFile();
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  std::string_view contents() const { return contents_; }
+
+ private:
+  void* mapping_ = nullptr;
+  size_t mapping_size_ = 0;
+  std::string read_buffer_;
+  std::string_view contents_;
+
+  MappedFile() = default;
+
+  // Returns false if `fd` cannot be mapped.
+  bool Map(int fd);
+  // Returns false, with errno set, if reading `fd` fails.
+  bool ReadAll(int fd);
+};
+
+// Program input. A regular file is mapped up front so that reading is a
+// pointer bump; anything else is read ahead in large chunks.
+class InputBuffer {
+ public:
+  static constexpr size_t DefaultCapacity = 64 * 1024;
+  static constexpr int Eof = -1;
+
+  explicit InputBuffer(int fd, size_t capacity = DefaultCapacity);
+  // Reads from memory only.
+  explicit InputBuffer(std::string_view contents);
+  ~InputBuffer();
+
+  InputBuffer(const InputBuffer&) = delete;
+  InputBuffer& operator=(const InputBuffer&) = delete;
+
+  // Gives `output` a chance to flush whenever reading would block, like
+  // std::ios::tie. Does not take ownership.
+  void Tie(OutputBuffer* output) { tied_output_ = output; }
+
+  // Bytes returned by Get so far.
+  uint64_t position() const { return read_ - (end_ - pos_); }
+
+  // Returns the next byte of input, or Eof.
+  int Get() {
+    if (pos_ != end_) {
+      return static_cast<unsigned char>(*pos_++);
+    }
+    return Refill();
+  }
+
+ private:
+  const int fd_;
+  const size_t capacity_;
+  // Null if all of the input is already in memory.
+  std::unique_ptr<char[]> buffer_;
+  std::unique_ptr<MappedFile> mapping_;
+  OutputBuffer* tied_output_ = nullptr;
+  const char* pos_ = nullptr;
+  const char* end_ = nullptr;
+  // Bytes brought into memory so far.
+  uint64_t read_ = 0;
+
+  int Refill();
+};
+
+}  // namespace dev::spiralgerbil::bf
+
+#endif  // DEV_SPIRALGERBIL_BF_INTERPRETER_IO_H_
@@ -0,0 +1,140 @@
+#include "bf/interpreter/profile.h"
+
+#include <algorithm>
+#include <numeric>
+#include <sstream>
+
+#include "absl/strings/str_format.h"
+
+#include "bf/compiler/cell.h"
+
+namespace dev::spiralgerbil::bf {
+
+LoopProfile::LoopProfile(const ast::Tree& program) {
+  loops_.push_back({SourceLocation{}, -1, 0, 0, Counts{}});
+  loops_[0].counts.entries = 1;
+  loops_[0].counts.iterations = 1;
+  Index(program, HashLoops(program), 0, 0);
+}
+
+void LoopProfile::Index(const NodeContainer& container,
+                        const absl::flat_hash_map<const ast::Loop*, uint64_t>& hashes, int parent,
+                        int depth) {
+  for (const Node& node : container.children()) {
+    if (node.type() == NodeType::Loop) {
+      const auto& loop = static_cast<const ast::Loop&>(node);
+      const int index = loops_.size();
+      loops_.push_back({loop.location(), parent, depth + 1, hashes.at(&loop), Counts{}});
+      index_[&loop] = index;
+      Index(loop, hashes, index, depth + 1);
+    }
+  }
+}
+
+std::vector<uint64_t> LoopProfile::InclusiveNodes() const {
+  std::vector<uint64_t> inclusive(loops_.size());
+  // Children come after their parents in preorder.
+  for (int i = loops_.size() - 1; i >= 0; i--) {
+    inclusive[i] += loops_[i].counts.nodes;
+    if (loops_[i].parent >= 0) {
+      inclusive[loops_[i].parent] += inclusive[i];
+    }
+  }
+  return inclusive;
+}
+
+std::vector<int> LoopProfile::Sorted() const {
+  std::vector<int> order(loops_.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(), [this](int a, int b) {
+    return loops_[a].counts.nodes > loops_[b].counts.nodes;
+  });
+  return order;
+}
+
+std::string LoopProfile::Name(int loop) const {
+  if (loop == 0) {
+    return "program";
+  }
+  const SourceLocation& location = loops_[loop].location;
+  return absl::StrFormat("loop@%d:%d", location.line, location.column);
+}
+
+std::string LoopProfile::Report() const {
+  const std::vector<uint64_t> inclusive = InclusiveNodes();
+  const double total = std::max<uint64_t>(inclusive[0], 1);
+  std::stringstream buffer;
+  buffer << absl::StrFormat("%-16s %5s %12s %14s %14s %6s %14s %6s\n", "loop", "depth", "entries",
+                            "iterations", "self nodes", "self%", "total nodes", "total%");
+  for (int i : Sorted()) {
+    const Loop& loop = loops_[i];
+    buffer << absl::StrFormat("%-16s %5d %12d %14d %14d %5.1f%% %14d %5.1f%%\n", Name(i), loop.depth,
+                              loop.counts.entries, loop.counts.iterations, loop.counts.nodes,
+                              100 * loop.counts.nodes / total, inclusive[i],
+                              100 * inclusive[i] / total);
+  }
+  return std::move(buffer).str();
+}
+
+std::string LoopProfile::Json() const {
+  const std::vector<uint64_t> inclusive = InclusiveNodes();
+  std::stringstream buffer;
+  buffer << "{\"total_nodes\": " << inclusive[0] << ", \"loops\": [";
+  const char* separator = "\n";
+  for (int i : Sorted()) {
+    const Loop& loop = loops_[i];
+    buffer << separator
+           << absl::StrFormat(
+                  "  {\"id\": %d, \"parent\": %d, \"line\": %d, \"column\": %d, \"depth\": %d, "
+                  "\"entries\": %d, \"iterations\": %d, \"self_nodes\": %d, \"total_nodes\": %d}",
+                  i, loop.parent, loop.location.line, loop.location.column, loop.depth,
+                  loop.counts.entries, loop.counts.iterations, loop.counts.nodes, inclusive[i]);
+    separator = ",\n";
+  }
+  buffer << "\n]}\n";
+  return std::move(buffer).str();
+}
+
+std::string LoopProfile::CollapsedStacks() const {
+  std::stringstream buffer;
+  for (size_t i = 0; i < loops_.size(); i++) {
+    if (loops_[i].counts.nodes == 0) {
+      continue;
+    }
+    std::vector<int> stack;
+    for (int loop = i; loop >= 0; loop = loops_[loop].parent) {
+      stack.push_back(loop);
+    }
+    const char* separator = "";
+    for (auto iter = stack.rbegin(); iter != stack.rend(); ++iter) {
+      buffer << separator << Name(*iter);
+      separator = ";";
+    }
+    buffer << " " << loops_[i].counts.nodes << "\n";
+  }
+  return std::move(buffer).str();
+}
+
+SavedProfile LoopProfile::Save(int cell_bits) const {
+  SavedProfile saved(cell_bits);
+  saved.set_total_nodes(InclusiveNodes()[0]);
+  for (size_t i = 1; i < loops_.size(); i++) {
+    const Counts& counts = loops_[i].counts;
+    if (counts.entries == 0) {
+      continue;
+    }
+    SavedProfile::Loop loop{counts.entries, counts.iterations, counts.nodes};
+    uint32_t entry_value = 0;
+    for (const auto& [value, count] : counts.entry_values) {
+      if (count > loop.entry_value_count || (count == loop.entry_value_count && value < entry_value)) {
+        entry_value = value;
+        loop.entry_value_count = count;
+      }
+    }
+    loop.entry_value = WrapToCell(entry_value, cell_bits);
+    saved.Add(loops_[i].hash, loop);
+  }
+  return saved;
+}
+
+}  // namespace dev::spiralgerbil::bf
@@ -0,0 +1,80 @@
+#ifndef DEV_SPIRALGERBIL_BF_INTERPRETER_PROFILE_H_
+#define DEV_SPIRALGERBIL_BF_INTERPRETER_PROFILE_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+
+#include "bf/compiler/ast.h"
+#include "bf/compiler/pgo.h"
+
+namespace dev::spiralgerbil::bf {
+
+// Execution counts for each loop of a program, gathered by InterpAstProfiled.
+class LoopProfile {
+ public:
+  struct Counts {
+    // Times the loop was reached, and times its body ran.
+    uint64_t entries = 0;
+    uint64_t iterations = 0;
+    // Nodes executed directly in the body, not counting nested loops.
+    uint64_t nodes = 0;
+    // How often the loop's cell had each value on entry, for the first
+    // MaxEntryValues distinct values.
+    absl::flat_hash_map<uint32_t, uint64_t> entry_values;
+
+    void Enter(uint32_t value) {
+      entries++;
+      if (entry_values.size() < MaxEntryValues || entry_values.contains(value)) {
+        entry_values[value]++;
+      }
+    }
+  };
+
+  static constexpr size_t MaxEntryValues = 16;
+
+  explicit LoopProfile(const ast::Tree& program);
+
+  // Counts for the top level of the program.
+  Counts* program() { return &loops_[0].counts; }
+  Counts* ForLoop(const ast::Loop& loop) { return &loops_[index_.at(&loop)].counts; }
+
+  // Loops sorted by the nodes they executed themselves, hottest first.
+  std::string Report() const;
+  std::string Json() const;
+  // One line per loop in the format of flamegraph.pl, e.g.
+  // "program;loop@3:5;loop@4:1 1234".
+  std::string CollapsedStacks() const;
+  // The counts to optimize the program with on later runs, for cells of
+  // `cell_bits` bits.
+  SavedProfile Save(int cell_bits) const;
+
+ private:
+  struct Loop {
+    SourceLocation location;
+    // Index of the enclosing loop, or -1 for the program itself.
+    int parent;
+    int depth;
+    // From HashLoops, or zero for the program itself.
+    uint64_t hash;
+    Counts counts;
+  };
+
+  // Indexed in preorder, with the program itself first.
+  std::vector<Loop> loops_;
+  absl::flat_hash_map<const ast::Loop*, int> index_;
+
+  void Index(const NodeContainer& container,
+             const absl::flat_hash_map<const ast::Loop*, uint64_t>& hashes, int parent, int depth);
+  // Nodes executed in each loop, including nested loops.
+  std::vector<uint64_t> InclusiveNodes() const;
+  // Indices of the loops, hottest first.
+  std::vector<int> Sorted() const;
+  std::string Name(int loop) const;
+};
+
+}  // namespace dev::spiralgerbil::bf
+
+#endif  // DEV_SPIRALGERBIL_BF_INTERPRETER_PROFILE_H_
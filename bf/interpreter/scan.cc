@@ -0,0 +1,174 @@
+#include "bf/interpreter/scan.h"
+
+#include <cstdint>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+#include "bf/compiler/cell.h"
+
+namespace dev::spiralgerbil::bf {
+namespace {
+
+template <typename Cell>
+Cell* ScanScalar(Cell* ptr, int stride) {
+  while (*ptr) {
+    ptr += stride;
+  }
+  return ptr;
+}
+
+#if defined(__x86_64__)
+
+// The lanes of a vector of `lanes` cells that are visited when stepping by
+// `stride` from its first lane (forward) or its last (backward), as bits of a
+// byte-granular movemask, and how far to advance to the next unvisited cell.
+struct LanePattern {
+  uint32_t mask = 0;
+  int step = 0;
+};
+
+template <typename Cell>
+constexpr uint32_t LaneBits = (uint32_t{1} << sizeof(Cell)) - 1;
+
+template <typename Cell>
+LanePattern ForwardLanes(int stride, int lanes) {
+  LanePattern pattern;
+  for (int lane = 0; lane < lanes; lane += stride) {
+    pattern.mask |= LaneBits<Cell> << (sizeof(Cell) * lane);
+    pattern.step += stride;
+  }
+  return pattern;
+}
+
+template <typename Cell>
+LanePattern BackwardLanes(int stride, int lanes) {
+  LanePattern pattern;
+  for (int lane = lanes - 1; lane >= 0; lane -= stride) {
+    pattern.mask |= LaneBits<Cell> << (sizeof(Cell) * lane);
+    pattern.step += stride;
+  }
+  return pattern;
+}
+
+// Only worth vectorizing if each load covers more than one visited cell.
+bool Vectorizable(int stride, int lanes) {
+  return stride != 0 && stride < lanes && -stride < lanes;
+}
+
+// Byte mask of the zero cells in a vector.
+template <typename Cell>
+uint32_t ZeroMask(__m128i cells) {
+  const __m128i zero = _mm_setzero_si128();
+  if constexpr (sizeof(Cell) == 1) {
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(cells, zero));
+  } else if constexpr (sizeof(Cell) == 2) {
+    return _mm_movemask_epi8(_mm_cmpeq_epi16(cells, zero));
+  } else {
+    return _mm_movemask_epi8(_mm_cmpeq_epi32(cells, zero));
+  }
+}
+
+template <typename Cell>
+__attribute__((target("avx2")))
+uint32_t ZeroMask(__m256i cells) {
+  const __m256i zero = _mm256_setzero_si256();
+  if constexpr (sizeof(Cell) == 1) {
+    return _mm256_movemask_epi8(_mm256_cmpeq_epi8(cells, zero));
+  } else if constexpr (sizeof(Cell) == 2) {
+    return _mm256_movemask_epi8(_mm256_cmpeq_epi16(cells, zero));
+  } else {
+    return _mm256_movemask_epi8(_mm256_cmpeq_epi32(cells, zero));
+  }
+}
+
+template <typename Cell>
+Cell* ScanSse2(Cell* ptr, int stride, const Cell* begin, const Cell* end) {
+  constexpr int Lanes = sizeof(__m128i) / sizeof(Cell);
+  if (!Vectorizable(stride, Lanes)) {
+    return ScanScalar(ptr, stride);
+  }
+  if (stride > 0) {
+    const LanePattern lanes = ForwardLanes<Cell>(stride, Lanes);
+    for (; ptr >= begin && ptr + Lanes <= end; ptr += lanes.step) {
+      const __m128i cells = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ptr));
+      const uint32_t found = ZeroMask<Cell>(cells) & lanes.mask;
+      if (found) {
+        return ptr + __builtin_ctz(found) / sizeof(Cell);
+      }
+    }
+  } else {
+    const LanePattern lanes = BackwardLanes<Cell>(-stride, Lanes);
+    for (; ptr - (Lanes - 1) >= begin && ptr < end; ptr -= lanes.step) {
+      const Cell* base = ptr - (Lanes - 1);
+      const __m128i cells = _mm_loadu_si128(reinterpret_cast<const __m128i*>(base));
+      const uint32_t found = ZeroMask<Cell>(cells) & lanes.mask;
+      if (found) {
+        return ptr - (Lanes - 1) + (31 - __builtin_clz(found)) / sizeof(Cell);
+      }
+    }
+  }
+  return ScanScalar(ptr, stride);
+}
+
+template <typename Cell>
+__attribute__((target("avx2")))
+Cell* ScanAvx2(Cell* ptr, int stride, const Cell* begin, const Cell* end) {
+  constexpr int Lanes = sizeof(__m256i) / sizeof(Cell);
+  if (!Vectorizable(stride, Lanes)) {
+    return ScanScalar(ptr, stride);
+  }
+  if (stride > 0) {
+    const LanePattern lanes = ForwardLanes<Cell>(stride, Lanes);
+    for (; ptr >= begin && ptr + Lanes <= end; ptr += lanes.step) {
+      const __m256i cells = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(ptr));
+      const uint32_t found = ZeroMask<Cell>(cells) & lanes.mask;
+      if (found) {
+        return ptr + __builtin_ctz(found) / sizeof(Cell);
+      }
+    }
+  } else {
+    const LanePattern lanes = BackwardLanes<Cell>(-stride, Lanes);
+    for (; ptr - (Lanes - 1) >= begin && ptr < end; ptr -= lanes.step) {
+      const Cell* base = ptr - (Lanes - 1);
+      const __m256i cells = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(base));
+      const uint32_t found = ZeroMask<Cell>(cells) & lanes.mask;
+      if (found) {
+        return ptr - (Lanes - 1) + (31 - __builtin_clz(found)) / sizeof(Cell);
+      }
+    }
+  }
+  // Finish near the ends of the tape with narrower vectors.
+  return ScanSse2(ptr, stride, begin, end);
+}
+
+template <typename Cell>
+using ScanFunction = Cell* (*)(Cell*, int, const Cell*, const Cell*);
+
+template <typename Cell>
+ScanFunction<Cell> SelectScan() {
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx2") ? &ScanAvx2<Cell> : &ScanSse2<Cell>;
+}
+
+#endif
+
+}  // namespace
+
+template <typename Cell>
+Cell* ScanForZero(Cell* ptr, int stride, const Cell* begin, const Cell* end) {
+#if defined(__x86_64__)
+  static const ScanFunction<Cell> scan = SelectScan<Cell>();
+  return scan(ptr, stride, begin, end);
+#else
+  return ScanScalar(ptr, stride);
+#endif
+}
+
+#define INSTANTIATE_SCAN(Cell) \
+  template Cell* ScanForZero<Cell>(Cell*, int, const Cell*, const Cell*);
+BF_FOR_EACH_CELL_TYPE(INSTANTIATE_SCAN)
+#undef INSTANTIATE_SCAN
+
+}  // namespace dev::spiralgerbil::bf
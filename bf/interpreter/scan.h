@@ -0,0 +1,14 @@
+#ifndef DEV_SPIRALGERBIL_BF_INTERPRETER_SCAN_H_
+#define DEV_SPIRALGERBIL_BF_INTERPRETER_SCAN_H_
+
+namespace dev::spiralgerbil::bf {
+
+// Returns the first cell at `ptr + k * stride`, k >= 0, that is zero. Cells
+// within [begin, end) are searched with SIMD where the stride allows it.
+// Instantiated for each cell type.
+template <typename Cell>
+Cell* ScanForZero(Cell* ptr, int stride, const Cell* begin, const Cell* end);
+
+}  // namespace dev::spiralgerbil::bf
+
+#endif  // DEV_SPIRALGERBIL_BF_INTERPRETER_SCAN_H_
@@ -0,0 +1,141 @@
+#include "bf/interpreter/snapshot.h"
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <cstring>
+
+#include "glog/logging.h"
+
+namespace dev::spiralgerbil::bf {
+namespace {
+
+static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__, "Fields are copied as they are");
+
+constexpr char Magic[8] = {'b', 'f', '-', 's', 'n', 'a', 'p', '\n'};
+constexpr size_t HeaderSize = sizeof(Magic) + 2 * 4 + 7 * 8;
+
+template <typename T>
+void Put(T value, std::string* data) {
+  data->append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+// Reads a T from the front of `data`, unless it is too short.
+template <typename T>
+bool Take(std::string_view* data, T* value) {
+  if (data->size() < sizeof(T)) {
+    return false;
+  }
+  std::memcpy(value, data->data(), sizeof(T));
+  data->remove_prefix(sizeof(T));
+  return true;
+}
+
+size_t TapePages(uint64_t cells, int cell_bits) {
+  return (cells * (cell_bits / 8) + Snapshot::PageSize - 1) / Snapshot::PageSize;
+}
+
+bool IsZero(const char* page) {
+  static const char zeros[Snapshot::PageSize] = {};
+  return std::memcmp(page, zeros, Snapshot::PageSize) == 0;
+}
+
+}  // namespace
+
+Snapshot::Snapshot(Tape* tape, int cell_bits, uint64_t program_hash, uint64_t pointer,
+                   uint64_t pc, uint64_t input_position, uint64_t output_position)
+    : cell_bits_(cell_bits),
+      program_hash_(program_hash),
+      tape_cells_(tape->size()),
+      pointer_(pointer),
+      pc_(pc),
+      input_position_(input_position),
+      output_position_(output_position) {
+  CHECK_EQ(tape->cell_size() * 8, cell_bits);
+  // Pages the program never touched are not resident, and are zero.
+  const size_t system_page = sysconf(_SC_PAGESIZE);
+  CHECK_EQ(system_page % PageSize, 0u);
+  const size_t pages = TapePages(tape_cells_, cell_bits);
+  std::vector<unsigned char> resident((pages * PageSize + system_page - 1) / system_page);
+  PCHECK(mincore(tape->bytes(), pages * PageSize, resident.data()) == 0)
+      << "Could not find the touched pages of the tape";
+  for (size_t page = 0; page < pages; page++) {
+    const char* bytes = tape->bytes() + page * PageSize;
+    if ((resident[page * PageSize / system_page] & 1) && !IsZero(bytes)) {
+      pages_.emplace_back(page, std::string(bytes, PageSize));
+    }
+  }
+}
+
+bool Snapshot::Parse(std::string_view data) {
+  *this = Snapshot();
+  uint32_t version = 0;
+  uint32_t cell_bits = 0;
+  uint64_t page_count = 0;
+  if (data.size() < HeaderSize || std::memcmp(data.data(), Magic, sizeof(Magic)) != 0) {
+    return false;
+  }
+  data.remove_prefix(sizeof(Magic));
+  Take(&data, &version);
+  Take(&data, &cell_bits);
+  Take(&data, &program_hash_);
+  Take(&data, &tape_cells_);
+  Take(&data, &pointer_);
+  Take(&data, &pc_);
+  Take(&data, &input_position_);
+  Take(&data, &output_position_);
+  Take(&data, &page_count);
+  if (version != Version || (cell_bits != 8 && cell_bits != 16 && cell_bits != 32) ||
+      tape_cells_ == 0 || pointer_ >= tape_cells_ ||
+      page_count > data.size() / (sizeof(uint64_t) + PageSize)) {
+    *this = Snapshot();
+    return false;
+  }
+  cell_bits_ = cell_bits;
+  const size_t pages = TapePages(tape_cells_, cell_bits_);
+  for (uint64_t i = 0; i < page_count; i++) {
+    uint64_t page = 0;
+    Take(&data, &page);
+    if (page >= pages || (!pages_.empty() && page <= pages_.back().first)) {
+      *this = Snapshot();
+      return false;
+    }
+    pages_.emplace_back(page, std::string(data.substr(0, PageSize)));
+    data.remove_prefix(PageSize);
+  }
+  if (!data.empty()) {
+    *this = Snapshot();
+    return false;
+  }
+  return true;
+}
+
+std::string Snapshot::Serialize() const {
+  std::string data(Magic, sizeof(Magic));
+  Put<uint32_t>(Version, &data);
+  Put<uint32_t>(cell_bits_, &data);
+  Put(program_hash_, &data);
+  Put(tape_cells_, &data);
+  Put(pointer_, &data);
+  Put(pc_, &data);
+  Put(input_position_, &data);
+  Put(output_position_, &data);
+  Put<uint64_t>(pages_.size(), &data);
+  DCHECK_EQ(data.size(), HeaderSize);
+  for (const auto& [page, bytes] : pages_) {
+    Put(page, &data);
+    data.append(bytes);
+  }
+  return data;
+}
+
+void Snapshot::Restore(Tape* tape) const {
+  CHECK_EQ(tape->size(), tape_cells_);
+  CHECK_EQ(tape->cell_size() * 8, static_cast<size_t>(cell_bits_));
+  // The tape's mapping is rounded up to whole pages, so the last one fits.
+  for (const auto& [page, bytes] : pages_) {
+    std::memcpy(tape->bytes() + page * PageSize, bytes.data(), PageSize);
+  }
+}
+
+}  // namespace dev::spiralgerbil::bf
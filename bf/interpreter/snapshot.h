@@ -0,0 +1,69 @@
+#ifndef DEV_SPIRALGERBIL_BF_INTERPRETER_SNAPSHOT_H_
+#define DEV_SPIRALGERBIL_BF_INTERPRETER_SNAPSHOT_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "bf/interpreter/tape.h"
+
+namespace dev::spiralgerbil::bf {
+
+// The state of a bytecode program that stopped between two instructions,
+// from which a later process can carry on. Only the pages of the tape that
+// are not all zero are kept, and untouched pages are not even looked at, so
+// a huge tape that is mostly zero takes a few kilobytes.
+//
+// It is saved as a little-endian stream:
+//
+//   header:  "bf-snap\n", u32 version, u32 cell bits, u64 program hash,
+//            u64 tape cells, u64 pointer, u64 pc, u64 input position,
+//            u64 output position, u64 page count
+//   pages:   u64 page index, then PageSize bytes of the tape
+class Snapshot {
+ public:
+  static constexpr int Version = 1;
+  static constexpr size_t PageSize = 4096;
+
+  Snapshot() = default;
+  // `program_hash` identifies the program, and everything else that it must
+  // be resumed with, as by HashBytecode. `pointer` is the index of the
+  // current cell, and `pc` that of the next instruction.
+  Snapshot(Tape* tape, int cell_bits, uint64_t program_hash, uint64_t pointer, uint64_t pc,
+           uint64_t input_position, uint64_t output_position);
+
+  // Parses the output of Serialize, copying the pages. Returns false if
+  // `data` is not a snapshot of this version, or is cut short.
+  bool Parse(std::string_view data);
+  std::string Serialize() const;
+
+  // Fills a cleared tape of tape_cells() cells of this width.
+  void Restore(Tape* tape) const;
+
+  int cell_bits() const { return cell_bits_; }
+  uint64_t program_hash() const { return program_hash_; }
+  uint64_t tape_cells() const { return tape_cells_; }
+  uint64_t pointer() const { return pointer_; }
+  uint64_t pc() const { return pc_; }
+  // Bytes of input read, and of output written, since the program started.
+  uint64_t input_position() const { return input_position_; }
+  uint64_t output_position() const { return output_position_; }
+
+ private:
+  int cell_bits_ = 0;
+  uint64_t program_hash_ = 0;
+  uint64_t tape_cells_ = 0;
+  uint64_t pointer_ = 0;
+  uint64_t pc_ = 0;
+  uint64_t input_position_ = 0;
+  uint64_t output_position_ = 0;
+  // Each non-zero page, by its index, in increasing order.
+  std::vector<std::pair<uint64_t, std::string>> pages_;
+};
+
+}  // namespace dev::spiralgerbil::bf
+
+#endif  // DEV_SPIRALGERBIL_BF_INTERPRETER_SNAPSHOT_H_
@@ -0,0 +1,213 @@
+#include "bf/interpreter/tape.h"
+
+#include <signal.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cstring>
+#include <memory>
+#include <mutex>
+
+#include "glog/logging.h"
+
+namespace dev::spiralgerbil::bf {
+
+// Live tapes, so the fault handler can tell guard region hits from genuine
+// crashes. Only touched with atomics, as it is read from a signal handler.
+struct Tape::Registration {
+  std::atomic<uintptr_t> mapping_begin;
+  std::atomic<uintptr_t> mapping_end;
+  std::atomic<uintptr_t> data;
+  std::atomic<size_t> cell_size;
+  std::atomic<sigjmp_buf*> recover;
+  std::atomic<intptr_t> fault_cell;
+};
+
+namespace {
+
+// The registry is a list of chunks that only ever grows, so the handler can
+// walk it without locks while other threads add to it. Slots are reused once
+// their tape is gone.
+struct RegistryChunk {
+  static constexpr int Size = 4096;
+
+  Tape::Registration tapes[Size];
+  std::atomic<RegistryChunk*> next{nullptr};
+};
+RegistryChunk registry;
+
+// The SIGSEGV action from before ours, for faults that are not on a tape.
+struct sigaction previous_action;
+
+size_t RoundUpToPage(size_t size) {
+  const size_t page = sysconf(_SC_PAGESIZE);
+  return (size + page - 1) / page * page;
+}
+
+void WriteString(const char* message) {
+  write(STDERR_FILENO, message, std::strlen(message));
+}
+
+void WriteNumber(intptr_t value) {
+  char buffer[24];
+  char* pos = buffer + sizeof(buffer);
+  const bool negative = value < 0;
+  uintptr_t magnitude = negative ? -static_cast<uintptr_t>(value) : value;
+  do {
+    *--pos = '0' + magnitude % 10;
+    magnitude /= 10;
+  } while (magnitude != 0);
+  if (negative) {
+    *--pos = '-';
+  }
+  write(STDERR_FILENO, pos, buffer + sizeof(buffer) - pos);
+}
+
+void HandleFault(int signal_number, siginfo_t* info, void* ucontext) {
+  const uintptr_t address = reinterpret_cast<uintptr_t>(info->si_addr);
+  for (RegistryChunk* chunk = &registry; chunk != nullptr; chunk = chunk->next.load()) {
+    for (Tape::Registration& tape : chunk->tapes) {
+      if (address >= tape.mapping_begin.load() && address < tape.mapping_end.load()) {
+        const intptr_t cell =
+            (static_cast<intptr_t>(address) - static_cast<intptr_t>(tape.data.load())) /
+            static_cast<intptr_t>(tape.cell_size.load());
+        tape.fault_cell = cell;
+        if (sigjmp_buf* recover = tape.recover.load()) {
+          siglongjmp(*recover, 1);
+        }
+        // Nobody is there to flush the output, which is not safe to do here.
+        WriteString("Tape pointer out of bounds: accessed cell ");
+        WriteNumber(cell);
+        WriteString("\n");
+        _exit(1);
+      }
+    }
+  }
+  // Not ours, so it is whoever handled SIGSEGV before us. Without a handler,
+  // the faulting instruction triggers the default action again once we return.
+  if (previous_action.sa_flags & SA_SIGINFO) {
+    previous_action.sa_sigaction(signal_number, info, ucontext);
+  } else if (previous_action.sa_handler == SIG_DFL || previous_action.sa_handler == SIG_IGN) {
+    signal(SIGSEGV, SIG_DFL);
+  } else {
+    previous_action.sa_handler(signal_number);
+  }
+}
+
+// The handler may run because the stack itself overflowed, so every thread
+// that runs programs needs a stack of its own to run it on. One the thread
+// already has is left alone.
+class AlternateStack {
+ public:
+  static constexpr size_t Size = 64 * 1024;
+
+  AlternateStack() {
+    stack_t current;
+    if (sigaltstack(nullptr, &current) != 0 || !(current.ss_flags & SS_DISABLE)) {
+      return;
+    }
+    memory_ = std::make_unique<char[]>(Size);
+    stack_t stack = {};
+    stack.ss_sp = memory_.get();
+    stack.ss_size = Size;
+    if (sigaltstack(&stack, nullptr) != 0) {
+      memory_.reset();
+    }
+  }
+
+  ~AlternateStack() {
+    if (memory_ != nullptr) {
+      stack_t stack = {};
+      stack.ss_flags = SS_DISABLE;
+      sigaltstack(&stack, nullptr);
+    }
+  }
+
+  AlternateStack(const AlternateStack&) = delete;
+  AlternateStack& operator=(const AlternateStack&) = delete;
+
+ private:
+  std::unique_ptr<char[]> memory_;
+};
+
+void SetUpThread() {
+  thread_local AlternateStack stack;
+}
+
+void InstallFaultHandler() {
+  static std::once_flag once;
+  std::call_once(once, [] {
+    struct sigaction action = {};
+    action.sa_sigaction = &HandleFault;
+    action.sa_flags = SA_SIGINFO | SA_ONSTACK;
+    sigemptyset(&action.sa_mask);
+    PCHECK(sigaction(SIGSEGV, &action, &previous_action) == 0);
+  });
+}
+
+}  // namespace
+
+Tape::Tape(size_t cells, size_t cell_size) : size_(cells), cell_size_(cell_size) {
+  CHECK(cells > 0);
+  InstallFaultHandler();
+  SetUpThread();
+  const size_t data_bytes = RoundUpToPage(cells * cell_size);
+  mapping_size_ = GuardBytes + data_bytes + GuardBytes;
+  mapping_ = mmap(nullptr, mapping_size_, PROT_NONE,
+                  MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  PCHECK(mapping_ != MAP_FAILED) << "Could not reserve tape";
+  data_ = static_cast<char*>(mapping_) + GuardBytes;
+  PCHECK(mprotect(data_, data_bytes, PROT_READ | PROT_WRITE) == 0) << "Could not map tape";
+
+  for (RegistryChunk* chunk = &registry;;) {
+    for (Registration& tape : chunk->tapes) {
+      uintptr_t expected = 0;
+      if (tape.mapping_begin.compare_exchange_strong(expected,
+                                                     reinterpret_cast<uintptr_t>(mapping_))) {
+        tape.data = reinterpret_cast<uintptr_t>(data_);
+        tape.cell_size = cell_size_;
+        tape.recover = nullptr;
+        tape.mapping_end = reinterpret_cast<uintptr_t>(mapping_) + mapping_size_;
+        registration_ = &tape;
+        return;
+      }
+    }
+    RegistryChunk* next = chunk->next.load();
+    if (next == nullptr) {
+      // Another thread may add a chunk first, in which case ours is not needed.
+      auto added = std::make_unique<RegistryChunk>();
+      if (chunk->next.compare_exchange_strong(next, added.get())) {
+        next = added.release();
+      }
+    }
+    chunk = next;
+  }
+}
+
+Tape::~Tape() {
+  registration_->mapping_end = 0;
+  registration_->data = 0;
+  registration_->recover = nullptr;
+  registration_->mapping_begin = 0;
+  munmap(mapping_, mapping_size_);
+}
+
+void Tape::Clear() {
+  // Private anonymous pages read as zero again once dropped.
+  PCHECK(madvise(data_, RoundUpToPage(size_ * cell_size_), MADV_DONTNEED) == 0)
+      << "Could not clear tape";
+}
+
+void Tape::RecoverOnFault(sigjmp_buf* target) {
+  if (target != nullptr) {
+    SetUpThread();
+  }
+  registration_->recover = target;
+}
+
+intptr_t Tape::fault_cell() const {
+  return registration_->fault_cell.load();
+}
+
+}  // namespace dev::spiralgerbil::bf
@@ -0,0 +1,96 @@
+#ifndef DEV_SPIRALGERBIL_BF_INTERPRETER_TAPE_H_
+#define DEV_SPIRALGERBIL_BF_INTERPRETER_TAPE_H_
+
+#include <setjmp.h>
+
+#include <cstddef>
+#include <cstdint>
+
+#include "glog/logging.h"
+
+#include "bf/compiler/cell.h"
+
+namespace dev::spiralgerbil::bf {
+
+// Program memory, reserved as one large virtual mapping. Pages are only
+// backed (and zeroed) by the kernel when first touched, so a huge tape costs
+// nothing until it is used. Both ends are surrounded by inaccessible guard
+// regions: moving off the tape and touching a cell there stops the program
+// with an error instead of corrupting memory, so the engines need no bounds
+// checks.
+class Tape {
+ public:
+  static constexpr size_t DefaultCells = size_t{1} << 26;
+  // As far as any offset or move may reach, so that an access from just
+  // outside the tape lands in a guard region. The tape itself is rounded up
+  // to whole pages.
+  static constexpr size_t GuardBytes = MaxReachBytes;
+
+  // Bookkeeping for the fault handler.
+  struct Registration;
+
+  Tape(size_t cells, size_t cell_size);
+  ~Tape();
+
+  Tape(const Tape&) = delete;
+  Tape& operator=(const Tape&) = delete;
+
+  // Runs `run`, which accesses the tape on this thread, and returns true. If
+  // it touches a guard region, returns false instead, with fault_cell() set,
+  // so that the caller can flush output and report it outside of the signal
+  // handler. Whatever `run` was doing is abandoned, so it must not hold
+  // anything that needs cleaning up.
+  template <typename F>
+  bool CatchFaults(F&& run) {
+    sigjmp_buf recover;
+    if (sigsetjmp(recover, 1) != 0) {
+      RecoverOnFault(nullptr);
+      return false;
+    }
+    RecoverOnFault(&recover);
+    run();
+    RecoverOnFault(nullptr);
+    return true;
+  }
+
+  // Makes an out of bounds access siglongjmp to `target` instead of ending the
+  // process, or stops doing so if it is null. The access must happen on the
+  // thread that called sigsetjmp.
+  void RecoverOnFault(sigjmp_buf* target);
+
+  // The cell of the last out of bounds access, relative to the first one.
+  intptr_t fault_cell() const;
+
+  // Zeroes every cell, returning the pages that were touched to the kernel.
+  void Clear();
+
+  // Cells of the type the tape was created for.
+  template <typename Cell>
+  Cell* begin() {
+    DCHECK_EQ(sizeof(Cell), cell_size_);
+    return reinterpret_cast<Cell*>(data_);
+  }
+  template <typename Cell>
+  Cell* end() {
+    return begin<Cell>() + size_;
+  }
+
+  size_t size() const { return size_; }
+  size_t cell_size() const { return cell_size_; }
+
+  // The cells as raw bytes, for saving and restoring them.
+  char* bytes() { return data_; }
+  size_t byte_size() const { return size_ * cell_size_; }
+
+ private:
+  void* mapping_;
+  Registration* registration_ = nullptr;
+  size_t mapping_size_;
+  char* data_;
+  size_t size_;
+  size_t cell_size_;
+};
+
+}  // namespace dev::spiralgerbil::bf
+
+#endif  // DEV_SPIRALGERBIL_BF_INTERPRETER_TAPE_H_
@@ -0,0 +1,358 @@
+#include "bf/jit/jit.h"
+
+#include <sys/mman.h>
+
+#include <cstring>
+#include <initializer_list>
+#include <utility>
+#include <vector>
+
+#include "glog/logging.h"
+
+#include "bf/interpreter/context.h"
+#include "bf/interpreter/scan.h"
+
+namespace dev::spiralgerbil::bf {
+namespace {
+
+// Calling convention of the generated code: the tape pointer arrives in rdi
+// and stays in rbx, and the context passed to the callbacks arrives in rsi and
+// stays in r12.
+template <typename Cell>
+using EntryPoint = void (*)(Cell* tape, Context<Cell>* context);
+
+template <typename Cell>
+void JitOutput(Context<Cell>* context, int value) {
+  context->output->Put(value);
+}
+
+template <typename Cell, EofBehavior Eof>
+void JitInput(Context<Cell>* context, Cell* cell) {
+  context->template Read<Eof>(cell);
+}
+
+template <typename Cell>
+void JitWrite(Context<Cell>* context, const Cell* cells, const int32_t* offsets, int count) {
+  for (int i = 0; i < count; i++) {
+    context->output->Put(cells[offsets[i]]);
+  }
+}
+
+template <typename Cell>
+Cell* JitScan(Context<Cell>* context, Cell* ptr, int stride) {
+  return ScanForZero(ptr, stride, context->memory.template begin<Cell>(),
+                     context->memory.template end<Cell>());
+}
+
+// Emits code for cells of type `Cell`. Cell accesses use the byte, word or
+// dword form of each instruction accordingly.
+template <typename Cell, EofBehavior Eof>
+class Assembler {
+ public:
+  const std::vector<uint8_t>& code() const { return code_; }
+  size_t position() const { return code_.size(); }
+
+  void Emit(std::initializer_list<uint8_t> bytes) {
+    code_.insert(code_.end(), bytes);
+  }
+
+  void Emit32(uint32_t value) { EmitLittleEndian(value, 4); }
+  void Emit64(uint64_t value) { EmitLittleEndian(value, 8); }
+
+  // Overwrites the rel32 ending at `end` so that it points at `target`.
+  void PatchRel32(size_t end, size_t target) {
+    const int32_t rel = static_cast<int32_t>(target - end);
+    std::memcpy(&code_[end - 4], &rel, 4);
+  }
+
+  // Cells are addressed as [rbx + disp32].
+  static int32_t Disp(int offset) { return offset * static_cast<int32_t>(sizeof(Cell)); }
+
+  void Prologue() {
+    Emit({0x53});                    // push rbx
+    Emit({0x41, 0x54});              // push r12
+    Emit({0x48, 0x83, 0xEC, 0x08});  // sub rsp, 8 (keeps calls 16-byte aligned)
+    Emit({0x48, 0x89, 0xFB});        // mov rbx, rdi
+    Emit({0x49, 0x89, 0xF4});        // mov r12, rsi
+  }
+
+  void Epilogue() {
+    Emit({0x48, 0x83, 0xC4, 0x08});  // add rsp, 8
+    Emit({0x41, 0x5C});              // pop r12
+    Emit({0x5B});                    // pop rbx
+    Emit({0xC3});                    // ret
+  }
+
+  void Move(int distance) {
+    Emit({0x48, 0x81, 0xC3});  // add rbx, imm32
+    Emit32(Disp(distance));
+  }
+
+  void Add(int offset, int amount) {
+    OperandSizePrefix();
+    Emit({Wide ? 0x81 : 0x80, 0x83});  // add [rbx + disp32], imm
+    Emit32(Disp(offset));
+    EmitCell(amount);
+  }
+
+  void Set(int offset, int value) {
+    OperandSizePrefix();
+    Emit({Wide ? 0xC7 : 0xC6, 0x83});  // mov [rbx + disp32], imm
+    Emit32(Disp(offset));
+    EmitCell(value);
+  }
+
+  void AddMul(int offset, int multiplier, int source) {
+    LoadCell({0x83});           // eax = [rbx + disp32]
+    Emit32(Disp(source));
+    Emit({0x69, 0xC0});         // imul eax, eax, imm32
+    Emit32(multiplier);
+    OperandSizePrefix();
+    Emit({Wide ? 0x01 : 0x00, 0x83});  // add [rbx + disp32], eax/ax/al
+    Emit32(Disp(offset));
+  }
+
+  void Output(int offset) {
+    LoadCell({0xB3});          // esi = [rbx + disp32]
+    Emit32(Disp(offset));
+    Emit({0x4C, 0x89, 0xE7});  // mov rdi, r12
+    Call(reinterpret_cast<uintptr_t>(&JitOutput<Cell>));
+  }
+
+  void Write(const ast::Write::Offsets& offsets) {
+    Emit({0x4C, 0x89, 0xE7});        // mov rdi, r12
+    Emit({0x48, 0x89, 0xDE});        // mov rsi, rbx
+    Emit({0x48, 0x8D, 0x15});        // lea rdx, [rip + rel32]
+    Emit32(0);
+    tables_.push_back({position(), std::vector<int>(offsets.begin(), offsets.end())});
+    Emit({0xB9});                    // mov ecx, imm32
+    Emit32(offsets.size());
+    Call(reinterpret_cast<uintptr_t>(&JitWrite<Cell>));
+  }
+
+  void Scan(int stride) {
+    Emit({0x4C, 0x89, 0xE7});  // mov rdi, r12
+    Emit({0x48, 0x89, 0xDE});  // mov rsi, rbx
+    Emit({0xBA});              // mov edx, imm32
+    Emit32(stride);
+    Call(reinterpret_cast<uintptr_t>(&JitScan<Cell>));
+    Emit({0x48, 0x89, 0xC3});  // mov rbx, rax
+  }
+
+  // Appends the offset tables referenced by Write after the code. Must be
+  // called after all of the code has been emitted.
+  void EmitTables() {
+    while (position() % alignof(int32_t) != 0) {
+      Emit({0xCC});  // int3
+    }
+    for (const auto& [patch_end, offsets] : tables_) {
+      PatchRel32(patch_end, position());
+      for (int offset : offsets) {
+        Emit32(offset);
+      }
+    }
+    tables_.clear();
+  }
+
+  void Input(int offset) {
+    Emit({0x4C, 0x89, 0xE7});  // mov rdi, r12
+    Emit({0x48, 0x8D, 0xB3});  // lea rsi, [rbx + disp32]
+    Emit32(Disp(offset));
+    Call(reinterpret_cast<uintptr_t>(&JitInput<Cell, Eof>));
+  }
+
+  // Emits the loop head and returns the position its exit jump must be
+  // patched from.
+  size_t LoopBegin(int offset) { return JumpIfZero(offset); }
+
+  // The jumps below return the position to patch their target from.
+  size_t JumpIfZero(int offset) {
+    CompareCellToZero(offset);
+    Emit({0x0F, 0x84});  // je rel32
+    Emit32(0);
+    return position();
+  }
+
+  size_t JumpIfNotEqual(int offset, int value) {
+    OperandSizePrefix();
+    Emit({Wide ? 0x81 : 0x80, 0xBB});  // cmp [rbx + disp32], imm
+    Emit32(Disp(offset));
+    EmitCell(value);
+    Emit({0x0F, 0x85});  // jne rel32
+    Emit32(0);
+    return position();
+  }
+
+  size_t Jump() {
+    Emit({0xE9});  // jmp rel32
+    Emit32(0);
+    return position();
+  }
+
+  void LoopEnd(size_t begin, int offset) {
+    CompareCellToZero(offset);
+    Emit({0x0F, 0x85});  // jne rel32
+    Emit32(0);
+    PatchRel32(position(), begin);
+    PatchRel32(begin, position());
+  }
+
+ private:
+  std::vector<uint8_t> code_;
+  // Offset tables waiting to be emitted, with the rel32 that refers to them.
+  std::vector<std::pair<size_t, std::vector<int>>> tables_;
+
+  // Whether cells use the word or dword form of an instruction rather than the
+  // byte form.
+  static constexpr bool Wide = sizeof(Cell) > 1;
+
+  void OperandSizePrefix() {
+    if (sizeof(Cell) == 2) {
+      Emit({0x66});
+    }
+  }
+
+  void EmitCell(int value) { EmitLittleEndian(static_cast<uint32_t>(value), sizeof(Cell)); }
+
+  // Zero-extends the cell addressed by `modrm` into the register it names.
+  void LoadCell(std::initializer_list<uint8_t> modrm) {
+    if (sizeof(Cell) == 1) {
+      Emit({0x0F, 0xB6});  // movzx r32, byte
+    } else if (sizeof(Cell) == 2) {
+      Emit({0x0F, 0xB7});  // movzx r32, word
+    } else {
+      Emit({0x8B});  // mov r32, dword
+    }
+    Emit(modrm);
+  }
+
+  void EmitLittleEndian(uint64_t value, int bytes) {
+    for (int i = 0; i < bytes; i++) {
+      code_.push_back(static_cast<uint8_t>(value >> (8 * i)));
+    }
+  }
+
+  void CompareCellToZero(int offset) {
+    OperandSizePrefix();
+    Emit({Wide ? 0x83 : 0x80, 0xBB});  // cmp [rbx + disp32], imm8
+    Emit32(Disp(offset));
+    Emit({0x00});
+  }
+
+  void Call(uintptr_t target) {
+    Emit({0x48, 0xB8});  // mov rax, imm64
+    Emit64(target);
+    Emit({0xFF, 0xD0});  // call rax
+  }
+};
+
+template <typename Cell, EofBehavior Eof>
+void Compile_rec(const NodeContainer& container, Assembler<Cell, Eof>* assembler);
+
+// Follows the hints of the profile-guided pass: a specialized loop first
+// checks for its usual entry value and then runs its body the known number of
+// times, and an unrolled loop tests its cell between the copies of its body.
+template <typename Cell, EofBehavior Eof>
+void CompileLoop(const ast::Loop& loop, Assembler<Cell, Eof>* assembler) {
+  const LoopHints& hints = loop.hints();
+  size_t specialized_end = 0;
+  if (hints.trip_count > 0) {
+    const size_t generic = assembler->JumpIfNotEqual(loop.offset(), hints.entry_value);
+    for (int i = 0; i < hints.trip_count; i++) {
+      Compile_rec(loop, assembler);
+    }
+    specialized_end = assembler->Jump();
+    assembler->PatchRel32(generic, assembler->position());
+  }
+  const size_t begin = assembler->LoopBegin(loop.offset());
+  std::vector<size_t> exits;
+  for (int i = 0; i < hints.unroll; i++) {
+    if (i > 0) {
+      exits.push_back(assembler->JumpIfZero(loop.offset()));
+    }
+    Compile_rec(loop, assembler);
+  }
+  assembler->LoopEnd(begin, loop.offset());
+  for (size_t exit : exits) {
+    assembler->PatchRel32(exit, assembler->position());
+  }
+  if (specialized_end != 0) {
+    assembler->PatchRel32(specialized_end, assembler->position());
+  }
+}
+
+template <typename Cell, EofBehavior Eof>
+void Compile_rec(const NodeContainer& container, Assembler<Cell, Eof>* assembler) {
+  for (const auto& node : container.children()) {
+    switch (node.type()) {
+      case NodeType::Move:
+        assembler->Move(static_cast<const ast::Move&>(node).distance());
+        break;
+      case NodeType::Add:
+        assembler->Add(node.offset(), static_cast<const ast::Add&>(node).amount());
+        break;
+      case NodeType::Output:
+        assembler->Output(node.offset());
+        break;
+      case NodeType::Input:
+        assembler->Input(node.offset());
+        break;
+      case NodeType::Loop:
+        CompileLoop(static_cast<const ast::Loop&>(node), assembler);
+        break;
+      case NodeType::Set:
+        assembler->Set(node.offset(), static_cast<const ast::Set&>(node).value());
+        break;
+      case NodeType::AddMul: {
+        const auto& addmul = static_cast<const ast::AddMul&>(node);
+        assembler->AddMul(addmul.offset(), addmul.multiplier(), addmul.source());
+        break;
+      }
+      case NodeType::Write:
+        assembler->Write(static_cast<const ast::Write&>(node).offsets());
+        break;
+      case NodeType::Scan:
+        assembler->Scan(static_cast<const ast::Scan&>(node).stride());
+        break;
+      default:
+        LOG(FATAL) << "Cannot compile node: " << node.DebugString();
+    }
+  }
+}
+
+}  // namespace
+
+template <typename Cell, EofBehavior Eof>
+JitProgram<Cell, Eof>::JitProgram(const ast::Tree& program) {
+#if !defined(__x86_64__)
+  LOG(FATAL) << "The JIT only supports x86-64.";
+#endif
+  Assembler<Cell, Eof> assembler;
+  assembler.Prologue();
+  Compile_rec(program, &assembler);
+  assembler.Epilogue();
+  assembler.EmitTables();
+
+  const std::vector<uint8_t>& code = assembler.code();
+  size_ = code.size();
+  code_ = mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  PCHECK(code_ != MAP_FAILED) << "Could not map JIT code buffer";
+  std::memcpy(code_, code.data(), size_);
+  PCHECK(mprotect(code_, size_, PROT_READ | PROT_EXEC) == 0) << "Could not make JIT code executable";
+}
+
+template <typename Cell, EofBehavior Eof>
+JitProgram<Cell, Eof>::~JitProgram() {
+  munmap(code_, size_);
+}
+
+template <typename Cell, EofBehavior Eof>
+void JitProgram<Cell, Eof>::Run(Context<Cell>* context) const {
+  reinterpret_cast<EntryPoint<Cell>>(code_)(context->mem_ptr, context);
+}
+
+#define INSTANTIATE_JIT_PROGRAM(Cell, Eof) template class JitProgram<Cell, Eof>;
+BF_FOR_EACH_CELL_CONFIG(INSTANTIATE_JIT_PROGRAM)
+#undef INSTANTIATE_JIT_PROGRAM
+
+}  // namespace dev::spiralgerbil::bf
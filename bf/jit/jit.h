@@ -0,0 +1,37 @@
+#ifndef DEV_SPIRALGERBIL_BF_JIT_JIT_H_
+#define DEV_SPIRALGERBIL_BF_JIT_JIT_H_
+
+#include <cstddef>
+#include <cstdint>
+
+#include "bf/compiler/ast.h"
+#include "bf/compiler/cell.h"
+#include "bf/interpreter/context.h"
+
+namespace dev::spiralgerbil::bf {
+
+// x86-64 machine code compiled from an optimized AST. The code lives in its
+// own executable mapping, which is released when the JitProgram is destroyed.
+// Instantiated for every cell type and EOF behavior.
+template <typename Cell, EofBehavior Eof>
+class JitProgram {
+ public:
+  explicit JitProgram(const ast::Tree& program);
+  ~JitProgram();
+
+  // Not copyable or movable, as the mapping is owned.
+  JitProgram(const JitProgram&) = delete;
+  JitProgram& operator=(const JitProgram&) = delete;
+
+  size_t code_size() const { return size_; }
+
+  void Run(Context<Cell>* context) const;
+
+ private:
+  void* code_ = nullptr;
+  size_t size_ = 0;
+};
+
+}  // namespace dev::spiralgerbil::bf
+
+#endif  // DEV_SPIRALGERBIL_BF_JIT_JIT_H_
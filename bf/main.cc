@@ -1,36 +1,369 @@
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
 #include <cstdio>
+#include <cstdlib>
 #include <fstream>
+#include <limits>
 #include <memory>
 #include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
 
 #include "absl/flags/flag.h"
 #include "absl/flags/parse.h"
 #include "absl/strings/str_format.h"
 #include "glog/logging.h"
 
+#include "bf/aot/emit_c.h"
+#include "bf/batch/batch.h"
+#include "bf/cache/program_cache.h"
 #include "bf/compiler/ast.h"
+#include "bf/compiler/bytecode.h"
+#include "bf/compiler/cell.h"
 #include "bf/compiler/optimizer.h"
 #include "bf/compiler/parser.h"
+#include "bf/compiler/partial_eval.h"
+#include "bf/compiler/pass_manager.h"
+#include "bf/compiler/pgo.h"
+#include "bf/compiler/serialize.h"
+#include "bf/interpreter/context.h"
 #include "bf/interpreter/interp_ast.h"
+#include "bf/interpreter/interp_bytecode.h"
+#include "bf/interpreter/interp_threaded.h"
+#include "bf/interpreter/io.h"
+#include "bf/interpreter/profile.h"
+#include "bf/interpreter/snapshot.h"
+#include "bf/interpreter/tape.h"
+#include "bf/jit/jit.h"
 
 ABSL_FLAG(std::string, input, "", "BF file to run.");
 ABSL_FLAG(bool, print, false, "Print AST and exit.");
+ABSL_FLAG(std::string, emit, "",
+          "Emit the optimized program in another language and exit: c, or bin for the binary "
+          "format that --load=bin runs.");
+ABSL_FLAG(std::string, load, "",
+          "Format of --input if it is not BF source: bin, for a program written by --emit=bin. "
+          "It runs as it was optimized, with the cell width it was optimized for.");
+ABSL_FLAG(std::string, engine, "ast", "Execution engine: ast, bytecode, threaded or jit.");
+ABSL_FLAG(uint64_t, tape_cells, dev::spiralgerbil::bf::Tape::DefaultCells,
+          "Number of cells on the tape. Only the pages that are touched use memory.");
+ABSL_FLAG(bool, pass_stats, false,
+          "Print the time, node counts and rewrites of each optimizer pass to stderr.");
+ABSL_FLAG(int, optimizer_iterations, dev::spiralgerbil::bf::PassManager::DefaultMaxIterations,
+          "Maximum number of times the optimizer repeats its passes looking for a fixpoint.");
+ABSL_FLAG(int64_t, partial_eval_budget, dev::spiralgerbil::bf::DefaultPartialEvalBudget,
+          "Nodes the optimizer may run while compiling, up to the first input, to replace with "
+          "the output and tape they leave. Zero turns this off, as do --profile and "
+          "--profile_out.");
+ABSL_FLAG(int, cell_bits, dev::spiralgerbil::bf::DefaultCellBits, "Width of a cell: 8, 16 or 32.");
+ABSL_FLAG(std::string, eof, "minus_one",
+          "What input stores once the input is exhausted: minus_one, zero or unchanged (leave "
+          "the cell as it was).");
+ABSL_FLAG(std::string, profile, "",
+          "Run with the ast engine, counting the entries, iterations and executed nodes of each "
+          "loop, and write a report to stderr: text, json or collapsed (stacks for "
+          "flamegraph.pl).");
+ABSL_FLAG(std::string, profile_out, "",
+          "Run with the ast engine like --profile, and save the loop counts to this file for "
+          "--profile_in.");
+ABSL_FLAG(std::string, profile_in, "",
+          "Unroll and specialize the loops that were hot in the run that saved this profile "
+          "with --profile_out. Loops are matched by their structure, so the profile still "
+          "applies to the unchanged loops of an edited program.");
+ABSL_FLAG(std::string, cache_dir, "",
+          "Directory to keep optimized programs in, keyed by their source, this binary and the "
+          "flags that affect optimization. A hit skips parsing and optimizing. Any number of "
+          "processes may share the directory.");
+ABSL_FLAG(std::string, batch, "",
+          "Instead of --input, run the jobs listed in this file, one per line as the path of a BF "
+          "program and optionally that of its input, on --threads threads, and write their "
+          "outputs in order. Each program is compiled once. Runs with the bytecode engine.");
+ABSL_FLAG(int, threads, 0, "Threads for --batch. Defaults to one per core.");
+ABSL_FLAG(uint64_t, fuel, 0,
+          "Stop programs that run longer than this, with an error. Each loop iteration costs the "
+          "number of bytecode instructions in the loop's body. Limits each job of --batch, or a "
+          "run with --engine=bytecode. Zero for no limit.");
+ABSL_FLAG(uint64_t, fuel_slice, 0,
+          "With --engine=bytecode, hand out fuel in slices of this size, stopping and resuming "
+          "the program after each one, as a host taking turns at many programs would. The "
+          "output is the same as without.");
+ABSL_FLAG(std::string, snapshot_out, "",
+          "With --engine=bytecode, save the state of a program that runs out of --fuel to this "
+          "file, for --resume_from.");
+ABSL_FLAG(std::string, resume_from, "",
+          "With --engine=bytecode, carry on from a state saved by --snapshot_out instead of "
+          "starting over. The program, --cell_bits and --eof must be the same as when it was "
+          "saved, and so must the input, whose bytes that were already read are skipped. The "
+          "output continues from where it stopped.");
+ABSL_FLAG(std::string, flush, "",
+          "When to flush output besides when the buffer is full: size (never), input (before "
+          "reading input) or line (also after newlines). Defaults to line for terminals and "
+          "input otherwise.");
 
 namespace dev::spiralgerbil::bf {
 namespace {
 
-void LoadAndRun(const std::string& filename, bool print_only) {
-  std::ifstream program_file(filename);
-  if (!program_file) {
-    LOG(FATAL) << "Could not open file: " << filename;
+struct RunOptions {
+  bool print_only;
+  bool pass_stats;
+  int optimizer_iterations;
+  int64_t partial_eval_budget;
+  std::string emit;
+  std::string load;
+  std::string engine;
+  std::string profile;
+  std::string profile_out;
+  std::string profile_in;
+  std::string cache_dir;
+  // Both unlimited if zero.
+  uint64_t fuel;
+  uint64_t fuel_slice;
+  std::string snapshot_out;
+  FlushPolicy flush_policy;
+  size_t tape_cells;
+  int cell_bits;
+  EofBehavior eof;
+};
+
+// The program to run: a tree, or the records of a --load=bin file, which the
+// bytecode engines lower without building a tree.
+class LoadedProgram {
+ public:
+  explicit LoadedProgram(std::unique_ptr<ast::Tree> tree) : tree_(std::move(tree)) {}
+  explicit LoadedProgram(const FlatProgram& flat) : flat_(flat) {}
+
+  // Built on first use for a --load=bin file.
+  ast::Tree* tree() {
+    if (tree_ == nullptr) {
+      tree_ = flat_.ToTree();
+    }
+    return tree_.get();
+  }
+
+  Bytecode bytecode() const {
+    return tree_ != nullptr ? LowerToBytecode(*tree_) : LowerToBytecode(flat_);
+  }
+
+ private:
+  std::unique_ptr<ast::Tree> tree_;
+  FlatProgram flat_;
+};
+
+// Runs `bytecode` in slices of --fuel_slice until it finishes or has used
+// --fuel, starting from `resume` unless it is null. Returns false if it ran
+// out, after saving a snapshot if asked to.
+template <typename Cell, EofBehavior Eof>
+bool RunWithFuel(const Bytecode& bytecode, Context<Cell>* context, const RunOptions& options,
+                 const Snapshot* resume) {
+  constexpr uint64_t Unlimited = std::numeric_limits<uint64_t>::max();
+  uint64_t budget = options.fuel != 0 ? options.fuel : Unlimited;
+  const uint64_t slice = options.fuel_slice != 0 ? options.fuel_slice : Unlimited;
+  uint64_t fuel = 0;
+  size_t pc = 0;
+  uint64_t output_position = 0;
+  if (resume != nullptr) {
+    // Programs only stop at the end of a loop.
+    CHECK(resume->program_hash() == HashBytecode(bytecode) && resume->pc() < bytecode.size() &&
+          bytecode[resume->pc()].op == bytecode::OpCode::LoopEnd)
+        << "The snapshot is of another program, or one optimized with other flags.";
+    resume->Restore(&context->memory);
+    context->mem_ptr = context->memory.template begin<Cell>() + resume->pointer();
+    pc = resume->pc();
+    while (context->input->position() < resume->input_position()) {
+      CHECK(context->input->Get() != InputBuffer::Eof)
+          << "The input is shorter than when the snapshot was saved.";
+    }
+    output_position = resume->output_position();
+  }
+  for (;;) {
+    // Fuel left over from a slice carries into the next one, so that loops
+    // whose iterations cost more than a slice still make progress.
+    const uint64_t grant = std::min(budget, slice);
+    fuel += grant;
+    budget -= grant;
+    if (InterpBytecodeLimited<Cell, Eof>(bytecode, context, &fuel, &pc)) {
+      return true;
+    }
+    if (budget == 0) {
+      break;
+    }
+  }
+  if (!options.snapshot_out.empty()) {
+    context->output->Flush();
+    const Snapshot snapshot(&context->memory, sizeof(Cell) * 8, HashBytecode(bytecode),
+                            context->mem_ptr - context->memory.template begin<Cell>(), pc,
+                            context->input->position(),
+                            output_position + context->output->position());
+    std::ofstream file(options.snapshot_out, std::ios::binary);
+    CHECK(file << snapshot.Serialize()) << "Could not write " << options.snapshot_out;
+  }
+  return false;
+}
+
+// Runs the program with the engine from `options`. Returns false if it ran
+// out of fuel.
+template <typename Cell, EofBehavior Eof>
+bool RunEngine(LoadedProgram* loaded, const RunOptions& options, const Snapshot* resume,
+               Context<Cell>* context) {
+  const std::string& engine = options.engine;
+  if (!options.profile.empty() || !options.profile_out.empty()) {
+    const ast::Tree& program = *loaded->tree();
+    LoopProfile profile(program);
+    InterpAstProfiled<Cell, Eof>(program, context, &profile);
+    context->output->Flush();
+    if (options.profile == "json") {
+      std::fputs(profile.Json().c_str(), stderr);
+    } else if (options.profile == "collapsed") {
+      std::fputs(profile.CollapsedStacks().c_str(), stderr);
+    } else if (options.profile == "text") {
+      std::fputs(profile.Report().c_str(), stderr);
+    }
+    if (!options.profile_out.empty()) {
+      std::ofstream file(options.profile_out);
+      CHECK(file << profile.Save(options.cell_bits).Serialize())
+          << "Could not write " << options.profile_out;
+    }
+  } else if (engine == "ast") {
+    if (options.print_only) {
+      std::puts(loaded->tree()->DebugString().c_str());
+    } else {
+      InterpAst<Cell, Eof>(*loaded->tree(), context);
+    }
+  } else if (engine == "bytecode" || engine == "threaded") {
+    Bytecode bytecode = loaded->bytecode();
+    if (options.print_only) {
+      std::fputs(BytecodeDebugString(bytecode).c_str(), stdout);
+    } else if (engine == "bytecode") {
+      if (options.fuel != 0 || options.fuel_slice != 0 || resume != nullptr) {
+        return RunWithFuel<Cell, Eof>(bytecode, context, options, resume);
+      }
+      InterpBytecode<Cell, Eof>(bytecode, context);
+    } else {
+      InterpThreaded<Cell, Eof>(bytecode, context);
+    }
+  } else if (engine == "jit") {
+    JitProgram<Cell, Eof> jit_program(*loaded->tree());
+    if (options.print_only) {
+      std::printf("%zu bytes of machine code\n", jit_program.code_size());
+    } else {
+      jit_program.Run(context);
+    }
+  } else {
+    LOG(FATAL) << "Unknown engine: " << engine;
+  }
+  return true;
+}
+
+// Returns false if the program ran out of fuel.
+template <typename Cell, EofBehavior Eof>
+bool Run(LoadedProgram* loaded, const RunOptions& options, const Snapshot* resume) {
+  OutputBuffer output(STDOUT_FILENO, options.flush_policy);
+  InputBuffer input(STDIN_FILENO);
+  input.Tie(&output);
+  Context<Cell> context(&output, &input, options.tape_cells);
+  bool finished = false;
+  const bool in_bounds = context.memory.CatchFaults(
+      [&] { finished = RunEngine<Cell, Eof>(loaded, options, resume, &context); });
+  // The output printed before a fault is still worth having.
+  output.Flush();
+  if (!in_bounds) {
+    std::fprintf(stderr, "Tape pointer out of bounds: accessed cell %ld\n",
+                 static_cast<long>(context.memory.fault_cell()));
+    std::exit(1);
+  }
+  return finished;
+}
+
+// Parses and optimizes `source`, using `saved_profile` unless it is empty.
+std::unique_ptr<ast::Tree> Compile(std::string_view source, std::string_view saved_profile,
+                                   const RunOptions& options) {
+  std::unique_ptr<ast::Tree> program = Parse(source);
+  SavedProfile profile;
+  const bool use_profile = !saved_profile.empty() && profile.Parse(saved_profile);
+  if (!saved_profile.empty() && !use_profile) {
+    LOG(WARNING) << "Ignoring " << options.profile_in
+                 << ", which was saved in another profile format version.";
+  }
+  PassManager pass_manager(options.optimizer_iterations, options.pass_stats);
+  AddDefaultPasses(&pass_manager, options.cell_bits, use_profile ? &profile : nullptr,
+                   options.partial_eval_budget);
+  pass_manager.Run(program.get());
+  if (options.pass_stats) {
+    std::fputs(pass_manager.StatsString().c_str(), stderr);
+  }
+  return program;
+}
+
+// Returns false if the program ran out of fuel.
+bool LoadAndRun(const std::string& filename, RunOptions options,
+                const std::string& resume_from) {
+  const MappedFile file(filename);
+  std::unique_ptr<LoadedProgram> program;
+  if (options.load == "bin") {
+    FlatProgram flat;
+    if (!flat.Parse(file.contents())) {
+      LOG(FATAL) << filename << " was not written by --emit=bin, or by another version of it.";
+    }
+    // The constants were folded for this width.
+    options.cell_bits = flat.cell_bits();
+    program = std::make_unique<LoadedProgram>(flat);
+  } else {
+    std::unique_ptr<MappedFile> saved_profile;
+    if (!options.profile_in.empty()) {
+      saved_profile = std::make_unique<MappedFile>(options.profile_in);
+    }
+    const std::string_view profile = saved_profile ? saved_profile->contents() : "";
+    std::unique_ptr<ast::Tree> tree;
+    if (options.cache_dir.empty()) {
+      tree = Compile(file.contents(), profile, options);
+    } else {
+      // Everything the optimized program depends on, with the source last so
+      // that the key is unambiguous.
+      const std::string key =
+          absl::StrFormat("cell_bits=%d\noptimizer_iterations=%d\npartial_eval_budget=%d\n"
+                          "profile=%d:%s\nsource=%s",
+                          options.cell_bits, options.optimizer_iterations,
+                          options.partial_eval_budget, profile.size(), profile, file.contents());
+      const ProgramCache cache(options.cache_dir);
+      tree = cache.Lookup(key);
+      if (tree == nullptr) {
+        tree = Compile(file.contents(), profile, options);
+        cache.Store(key, *tree, options.cell_bits);
+      }
+    }
+    program = std::make_unique<LoadedProgram>(std::move(tree));
   }
-  std::unique_ptr<ast::Tree> program = Parse(&program_file);
-  Optimize(program.get());
-  if (print_only) {
-    std::puts(program->DebugString().c_str());
+  if (options.emit == "c") {
+    std::fputs(EmitC(program->tree(), options.cell_bits, options.eof).c_str(), stdout);
+  } else if (options.emit == "bin") {
+    const std::string data = Serialize(*program->tree(), options.cell_bits);
+    std::fwrite(data.data(), 1, data.size(), stdout);
+  } else if (!options.emit.empty()) {
+    LOG(FATAL) << "Unknown emit target: " << options.emit;
   } else {
-    InterpAst(*program);
+    std::unique_ptr<Snapshot> resume;
+    if (!resume_from.empty()) {
+      resume = std::make_unique<Snapshot>();
+      if (!resume->Parse(MappedFile(resume_from).contents())) {
+        LOG(FATAL) << resume_from << " was not written by --snapshot_out, or by another version "
+                   << "of it.";
+      }
+      if (resume->cell_bits() != options.cell_bits) {
+        LOG(FATAL) << resume_from << " was saved with --cell_bits=" << resume->cell_bits();
+      }
+      options.tape_cells = resume->tape_cells();
+    }
+    return DispatchCell(options.cell_bits, options.eof, [&](auto cell, auto eof) {
+      return Run<typename decltype(cell)::type, decltype(eof)::value>(program.get(), options,
+                                                                      resume.get());
+    });
   }
+  return true;
 }
 
 }  // namespace
@@ -43,5 +376,96 @@ int main(int argc, char* argv[]) {
     LOG(ERROR) << "Too many arguments.";
     return -1;
   }
-  dev::spiralgerbil::bf::LoadAndRun(absl::GetFlag(FLAGS_input), absl::GetFlag(FLAGS_print));
+  namespace bf = dev::spiralgerbil::bf;
+  if (absl::GetFlag(FLAGS_tape_cells) == 0) {
+    LOG(ERROR) << "--tape_cells must be positive.";
+    return -1;
+  }
+  bf::RunOptions options;
+  options.print_only = absl::GetFlag(FLAGS_print);
+  options.pass_stats = absl::GetFlag(FLAGS_pass_stats);
+  options.optimizer_iterations = absl::GetFlag(FLAGS_optimizer_iterations);
+  options.partial_eval_budget = absl::GetFlag(FLAGS_partial_eval_budget);
+  options.emit = absl::GetFlag(FLAGS_emit);
+  options.load = absl::GetFlag(FLAGS_load);
+  if (!options.load.empty() && options.load != "bin") {
+    LOG(ERROR) << "Unknown input format: " << options.load;
+    return -1;
+  }
+  options.engine = absl::GetFlag(FLAGS_engine);
+  options.profile = absl::GetFlag(FLAGS_profile);
+  if (!options.profile.empty() && options.profile != "text" && options.profile != "json" &&
+      options.profile != "collapsed") {
+    LOG(ERROR) << "Unknown profile format: " << options.profile;
+    return -1;
+  }
+  options.profile_out = absl::GetFlag(FLAGS_profile_out);
+  // A profile is of the program's loops, which would otherwise have run while
+  // compiling.
+  if (!options.profile.empty() || !options.profile_out.empty()) {
+    options.partial_eval_budget = 0;
+  }
+  options.profile_in = absl::GetFlag(FLAGS_profile_in);
+  options.cache_dir = absl::GetFlag(FLAGS_cache_dir);
+  options.fuel = absl::GetFlag(FLAGS_fuel);
+  options.fuel_slice = absl::GetFlag(FLAGS_fuel_slice);
+  if ((options.fuel != 0 && options.engine != "bytecode" && absl::GetFlag(FLAGS_batch).empty()) ||
+      (options.fuel_slice != 0 && options.engine != "bytecode")) {
+    LOG(ERROR) << "Fuel is only limited with --engine=bytecode or --batch.";
+    return -1;
+  }
+  options.snapshot_out = absl::GetFlag(FLAGS_snapshot_out);
+  const std::string resume_from = absl::GetFlag(FLAGS_resume_from);
+  if ((!options.snapshot_out.empty() || !resume_from.empty()) && options.engine != "bytecode") {
+    LOG(ERROR) << "Snapshots are only taken and resumed with --engine=bytecode.";
+    return -1;
+  }
+  if (!options.snapshot_out.empty() && options.fuel == 0) {
+    LOG(ERROR) << "--snapshot_out is saved when --fuel runs out, so needs --fuel.";
+    return -1;
+  }
+  options.tape_cells = absl::GetFlag(FLAGS_tape_cells);
+  options.cell_bits = absl::GetFlag(FLAGS_cell_bits);
+  if (!bf::IsValidCellBits(options.cell_bits)) {
+    LOG(ERROR) << "Unsupported cell width: " << options.cell_bits;
+    return -1;
+  }
+  const std::string eof = absl::GetFlag(FLAGS_eof);
+  if (!bf::ParseEofBehavior(eof, &options.eof)) {
+    LOG(ERROR) << "Unknown EOF behavior: " << eof;
+    return -1;
+  }
+  options.flush_policy = bf::DefaultFlushPolicy(STDOUT_FILENO);
+  const std::string flush = absl::GetFlag(FLAGS_flush);
+  if (!flush.empty() && !bf::ParseFlushPolicy(flush, &options.flush_policy)) {
+    LOG(ERROR) << "Unknown flush policy: " << flush;
+    return -1;
+  }
+  const std::string batch = absl::GetFlag(FLAGS_batch);
+  if (!batch.empty()) {
+    std::vector<bf::BatchJob> jobs;
+    std::string error;
+    if (!bf::ParseBatch(bf::MappedFile(batch).contents(), &jobs, &error)) {
+      LOG(ERROR) << batch << ": " << error;
+      return -1;
+    }
+    bf::BatchOptions batch_options;
+    batch_options.program.cell_bits = options.cell_bits;
+    batch_options.program.eof = options.eof;
+    batch_options.program.optimizer_iterations = options.optimizer_iterations;
+    batch_options.program.partial_eval_budget = options.partial_eval_budget;
+    batch_options.tape_cells = options.tape_cells;
+    if (options.fuel != 0) {
+      batch_options.fuel = options.fuel;
+    }
+    batch_options.threads = absl::GetFlag(FLAGS_threads);
+    if (batch_options.threads <= 0) {
+      batch_options.threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    return bf::RunBatch(jobs, batch_options, STDOUT_FILENO) == 0 ? 0 : 1;
+  }
+  if (!bf::LoadAndRun(absl::GetFlag(FLAGS_input), options, resume_from)) {
+    LOG(ERROR) << "Out of fuel" << (options.snapshot_out.empty() ? "." : "; saved a snapshot.");
+    return 1;
+  }
 }
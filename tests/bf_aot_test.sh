@@ -0,0 +1,3 @@
+set -euo pipefail
+
+tests/$1 | cmp - tests/$2.out
@@ -0,0 +1,73 @@
+set -uo pipefail
+
+# Writes a --emit=bin file for 16-bit cells with the given records, each a
+# type, offset and operand.
+bin() {
+  local file=$1
+  shift
+  { printf 'bf-ast\n\0'; words 1 16 $(($# / 3)) 0 "$@"; } > "$file"
+}
+
+# Little-endian 32-bit words.
+words() {
+  for word in "$@"; do
+    printf "$(printf '\\x%02x' $((word & 255)) $((word >> 8 & 255)) $((word >> 16 & 255)) \
+                                $((word >> 24 & 255)))"
+  done
+}
+
+# Adds 65 to the cell at offset $1, in a loop that runs once and has the
+# unroll factor $2, and prints it.
+add_at() {
+  bin "$TEST_TMPDIR/program.bin" 2 0 1  5 0 2  5 1 1  5 "$2" 0  5 0 0  2 "$1" 65  6 0 0  3 "$1" 0
+}
+
+# Moves by $1, $2 and $3, then adds 65 to the cell and prints it.
+moves() {
+  bin "$TEST_TMPDIR/program.bin" 1 0 "$1"  1 0 "$2"  1 0 "$3"  2 0 65  3 0 0
+}
+
+# Sets the cell to 1 and runs a loop that moves away and back and counts it
+# down, with the trip count $1 and entry value $2, then prints 'A'.
+moving_loop() {
+  bin "$TEST_TMPDIR/program.bin" 6 0 1  5 0 3  5 1 1  5 1 "$1"  5 "$2" 0  2 0 -1  1 0 1  1 0 -1 \
+      6 0 65  3 0 0
+}
+
+run() {
+  bf/bf --input "$TEST_TMPDIR/program.bin" --load=bin "$@" 2> "$TEST_TMPDIR/stderr"
+}
+
+rejected() {
+  if run "$@"; then
+    return 1
+  fi
+  grep -q "was not written by --emit=bin" "$TEST_TMPDIR/stderr"
+}
+
+add_at 1 1
+test "$(run "$@")" = A || exit 1
+
+# Far past the guard region before the tape.
+add_at -200000000 1
+rejected "$@" || exit 1
+
+add_at 1 2147483647
+rejected "$@" || exit 1
+
+# A Write of -1 cells.
+bin "$TEST_TMPDIR/program.bin" 8 0 -1
+rejected "$@" || exit 1
+
+# Moves that each stay within reach but add up to three times as far.
+moves 134217728 -134217728 0
+test "$(run "$@")" = A || exit 1
+moves 134217728 134217728 134217728
+rejected "$@" || exit 1
+
+# The copies of the body for a trip count run with no tests in between, so
+# only a body that stays where it is may have one.
+moving_loop 0 0
+test "$(run "$@")" = A || exit 1
+moving_loop 1 1
+rejected "$@"
@@ -0,0 +1,34 @@
+set -euo pipefail
+
+# Every program is listed several times, so that the threads share it, and
+# the outputs must come back in the order of the jobs.
+threads=$1
+shift
+for run in 1 2 3 4 5; do
+  for input in "$@"; do
+    echo "tests/$input.bf"
+    cat "tests/$input.out" >> "$TEST_TMPDIR/expected"
+  done
+done > "$TEST_TMPDIR/jobs"
+bf/bf --batch="$TEST_TMPDIR/jobs" --threads=$threads | cmp - "$TEST_TMPDIR/expected"
+
+# A job whose program or input is missing or is a directory fails on its own,
+# and the others are still written.
+{
+  echo "tests/$1.bf"
+  echo "$TEST_TMPDIR/missing.bf"
+  echo "tests/$1.bf $TEST_TMPDIR/missing.in"
+  echo "tests/$1.bf"
+  echo "tests"
+  echo "tests/$1.bf"
+} > "$TEST_TMPDIR/bad_jobs"
+cat "tests/$1.out" "tests/$1.out" "tests/$1.out" > "$TEST_TMPDIR/bad_expected"
+if bf/bf --batch="$TEST_TMPDIR/bad_jobs" --threads=$threads > "$TEST_TMPDIR/bad_output" \
+    2> "$TEST_TMPDIR/errors"; then
+  exit 1
+fi
+cmp "$TEST_TMPDIR/bad_output" "$TEST_TMPDIR/bad_expected"
+test "$(grep -c 'Could not open file' "$TEST_TMPDIR/errors")" = 2
+grep -q 'Job 2 ' "$TEST_TMPDIR/errors"
+grep -q 'Job 3 ' "$TEST_TMPDIR/errors"
+grep -q 'Job 5 .*Could not read file' "$TEST_TMPDIR/errors"
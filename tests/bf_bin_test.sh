@@ -0,0 +1,3 @@
+set -euo pipefail
+
+bf/bf --input tests/$1.bin --load=bin "${@:2}" | cmp - tests/$1.out
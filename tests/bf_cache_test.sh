@@ -0,0 +1,31 @@
+set -euo pipefail
+
+# Runs tests/$1.bf with the cache and compares its output, keeping the pass
+# statistics, which are only printed if the program was optimized and so
+# missed the cache.
+cache="$TEST_TMPDIR/cache"
+stats="$TEST_TMPDIR/stats"
+run() {
+  bf/bf --input "tests/$1.bf" --cache_dir="$cache" --pass_stats "${@:2}" 2> "$stats" |
+      cmp - "tests/$1.out"
+}
+
+run "$@"
+grep -q ConvertToOffsets "$stats"
+run "$@"
+if grep -q ConvertToOffsets "$stats"; then
+  exit 1
+fi
+
+# A damaged entry is a miss, and is written again.
+entry=$(ls "$cache"/*.bfc)
+position=$(($(stat -c %s "$entry") - 4))
+byte=$(od -An -tu1 -j "$position" -N1 "$entry")
+printf "$(printf '\\x%02x' $((byte ^ 1)))" |
+    dd of="$entry" bs=1 seek="$position" conv=notrunc status=none
+run "$@"
+grep -q ConvertToOffsets "$stats"
+run "$@"
+if grep -q ConvertToOffsets "$stats"; then
+  exit 1
+fi
@@ -1,3 +1,3 @@
-set -eu
+set -euo pipefail
 
-bf/bf --input tests/$1
+bf/bf --input tests/$1.bf "${@:3}" | cmp - tests/$2
@@ -0,0 +1,11 @@
+set -euo pipefail
+
+# Profiles the program with the default flags, which must count the same
+# loops as when nothing runs while compiling.
+report="$TEST_TMPDIR/report"
+bf/bf --input "tests/$1.bf" --profile=text 2> "$report" | cmp - "tests/$1.out"
+grep -q '^loop@' "$report"
+bf/bf --input "tests/$1.bf" --profile_out="$TEST_TMPDIR/default.profile" > /dev/null
+bf/bf --input "tests/$1.bf" --profile_out="$TEST_TMPDIR/no_partial_eval.profile" \
+    --partial_eval_budget=0 > /dev/null
+cmp "$TEST_TMPDIR/default.profile" "$TEST_TMPDIR/no_partial_eval.profile"
@@ -0,0 +1,26 @@
+set -uo pipefail
+
+# Runs the program $2 fuel at a time with the file $3 as its input, each run
+# resuming from the snapshot the one before saved, and checks that the
+# outputs add up to an uninterrupted run's.
+input="$3"
+snapshot="$TEST_TMPDIR/snapshot"
+output="$TEST_TMPDIR/output"
+expected="$TEST_TMPDIR/expected"
+bf/bf --input "tests/$1.bf" --engine=bytecode "${@:4}" < "$input" > "$expected" || exit 1
+cmp "$expected" "tests/$1.out" || exit 1
+args=(--input "tests/$1.bf" --engine=bytecode --fuel="$2" --snapshot_out="$snapshot" "${@:4}")
+: > "$output"
+for run in $(seq 1000); do
+  if bf/bf "${args[@]}" < "$input" >> "$output"; then
+    # Stopping at least once is the point.
+    test "$run" -gt 1 || exit 1
+    cmp "$output" "$expected"
+    exit
+  fi
+  test -s "$snapshot" || exit 1
+  mv "$snapshot" "$snapshot.in"
+  args=(--input "tests/$1.bf" --engine=bytecode --fuel="$2" --snapshot_out="$snapshot"
+        --resume_from="$snapshot.in" "${@:4}")
+done
+exit 1
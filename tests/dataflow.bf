@@ -0,0 +1,12 @@
+Exercises constant propagation and dead store elimination by printing OK
+
+A cleared cell that is then added to folds into a single Set
+[-]+++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++.
+A loop on a cell known to be zero never runs
+[-][.>+<]
+A store that is overwritten before it is read is dropped
+>++++++++++++++++++++[-]++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+Adds to one cell split by an output of another are merged
+>++<+++++.>+++
+A multiply loop on a cell with a known value becomes an Add
+<<[-]+++++[->>+<<]>>.
@@ -0,0 +1,5 @@
+Echoes its input and then counts down from one below its last byte to one
+Each byte is printed and stepped down by one before the next is read over it
+and once the input runs out the cell is left as it was with eof=unchanged
+
+,[.>++++[<+>-]<-----,]
@@ -0,0 +1,8 @@
+Closes linear loops and prints OK
+
+A nested loop with a constant trip count
++++++++[->+++++[->++<]<]>>+++++++++.
+A counter that steps by three runs a modular inverse of times
+>>+++++++++++++++[-<+++++++++++++++>]<[--->+<]>.
+A loop whose first iteration reads a cell it then sets is peeled
+>>++++<++++[->[->>+<<]++<]>>>.
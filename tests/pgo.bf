@@ -0,0 +1,12 @@
+Loops for a saved profile to find hot: the first inner loop starts from
+three on all but its first entry and the second one from five every time
+
+++++++++[>++++++++<-]>+           cell 1 = 'A'
+>+                                one extra on the first line
+<<++++++++++                      cell 0 = 10 lines
+[
+  >>+++[<.>-]                     print cell 1 three times
+  >>+++++[<<<.>>>-]               and five more
+  <<<+<-                          next letter
+  >>>>>++++++++++.[-]<<<<<        newline
+]
@@ -1,13 +1,180 @@
 """ BF test macros. """
 
-def bf_integration_test(input, size = "small"):
+def bf_profile(input):
+    """ Saves the loop counts of a run of <input>.bf to <input>.profile, for 16-bit cells. """
+    native.genrule(
+        name = input + "_profile",
+        srcs = [input + ".bf"],
+        outs = [input + ".profile"],
+        cmd = "$(location //bf) --input $< --profile_out=$@ > /dev/null",
+        tools = ["//bf"],
+    )
+
+def bf_profile_test(input):
+    """ Profiles <input>.bf with the default flags, checking that its loops are counted. """
+    native.sh_test(
+        name = "bf_profile_test__" + input,
+        srcs = ["bf_profile_test.sh"],
+        args = [input],
+        data = [
+            input + ".bf",
+            input + ".out",
+            "//bf",
+        ],
+    )
+
+def bf_integration_test(input, engine = "ast", cell_bits = 16, profile = False, fuel_slice = 0, partial_eval = True, size = "small"):
+    """ Compares the output with <input>.out, or <input>.cell<N>.out for other cell widths.
+
+    With `profile`, the program is optimized with the profile saved by bf_profile. With
+    `fuel_slice`, it is stopped and resumed every time it has used that much fuel. Without
+    `partial_eval`, none of it is run while compiling.
+    """
+    suffix = "" if engine == "ast" else "__" + engine
+    expected = input + ".out"
+    if cell_bits != 16:
+        suffix += "__cell" + str(cell_bits)
+        expected = input + ".cell" + str(cell_bits) + ".out"
+    args = [input, expected, "--engine=" + engine, "--cell_bits=" + str(cell_bits)]
+    data = [
+        input + ".bf",
+        expected,
+        "//bf",
+    ]
+    if profile:
+        suffix += "__pgo"
+        args.append("--profile_in=tests/" + input + ".profile")
+        data.append(input + ".profile")
+    if fuel_slice:
+        suffix += "__slice" + str(fuel_slice)
+        args.append("--fuel_slice=" + str(fuel_slice))
+    if not partial_eval:
+        suffix += "__no_partial_eval"
+        args.append("--partial_eval_budget=0")
     native.sh_test(
-        name = "bf_integration_test__" + input,
+        name = "bf_integration_test__" + input + suffix,
         srcs = ["bf_integration_test.sh"],
-        args = [input + ".bf"],
+        args = args,
+        data = data,
+        size = size,
+    )
+
+def bf_bin(input):
+    """ Writes the optimized <input>.bf to <input>.bin with --emit=bin. """
+    native.genrule(
+        name = input + "_bin",
+        srcs = [input + ".bf"],
+        outs = [input + ".bin"],
+        cmd = "$(location //bf) --input $< --emit=bin > $@",
+        tools = ["//bf"],
+    )
+
+def bf_bin_test(input, engine = "ast"):
+    """ Runs the <input>.bin of bf_bin with --load=bin and compares the output with <input>.out. """
+    native.sh_test(
+        name = "bf_bin_test__" + input + "__" + engine,
+        srcs = ["bf_bin_test.sh"],
+        args = [input, "--engine=" + engine],
+        data = [
+            input + ".bin",
+            input + ".out",
+            "//bf",
+        ],
+    )
+
+def bf_bad_bin_test(engine):
+    """ Checks that --load=bin rejects files with offsets or loop hints out of range. """
+    native.sh_test(
+        name = "bf_bad_bin_test__" + engine,
+        srcs = ["bf_bad_bin_test.sh"],
+        args = ["--engine=" + engine],
+        data = [
+            "//bf",
+        ],
+    )
+
+def bf_cache_test(input, engine = "ast"):
+    """ Runs <input>.bf with a fresh --cache_dir, checking that runs hit the cache unless the entry
+    is damaged, and comparing every output with <input>.out. """
+    native.sh_test(
+        name = "bf_cache_test__" + input + "__" + engine,
+        srcs = ["bf_cache_test.sh"],
+        args = [input, "--engine=" + engine],
         data = [
             input + ".bf",
+            input + ".out",
+            "//bf",
+        ],
+    )
+
+def bf_snapshot_test(input, fuel, partial_eval = True, stdin = False, eof = "minus_one"):
+    """ Runs <input>.bf `fuel` at a time, resuming each run from the snapshot of the one before.
+
+    The output must match both <input>.out and an uninterrupted run. With `stdin`, every run reads
+    <input>.in, and otherwise no input.
+    """
+    args = [input, str(fuel), "tests/" + input + ".in" if stdin else "/dev/null", "--eof=" + eof]
+    data = [
+        input + ".bf",
+        input + ".out",
+        "//bf",
+    ]
+    if stdin:
+        data.append(input + ".in")
+    if not partial_eval:
+        args.append("--partial_eval_budget=0")
+    native.sh_test(
+        name = "bf_snapshot_test__" + input,
+        srcs = ["bf_snapshot_test.sh"],
+        args = args,
+        data = data,
+    )
+
+def bf_batch_test(inputs, threads):
+    """ Runs <input>.bf for each of `inputs`, several times over, as one --batch, then a batch
+    with jobs whose files are missing. """
+    native.sh_test(
+        name = "bf_batch_test__threads" + str(threads),
+        srcs = ["bf_batch_test.sh"],
+        args = [str(threads)] + inputs,
+        data = [input + ".bf" for input in inputs] + [input + ".out" for input in inputs] + [
             "//bf",
         ],
+    )
+
+def bf_aot_test(input, profile = False, partial_eval = True, size = "small"):
+    """ Compiles <input>.bf to C with --emit=c, builds it, and compares its output with <input>.out.
+
+    With `profile`, the program is optimized with the profile saved by bf_profile. Without
+    `partial_eval`, none of it is run while compiling.
+    """
+    name = input + ("_pgo" if profile else "") + "_aot"
+    srcs = [input + ".bf"]
+    flags = "--emit=c"
+    if not partial_eval:
+        flags += " --partial_eval_budget=0"
+    if profile:
+        srcs.append(input + ".profile")
+        flags += " --profile_in=$(location " + input + ".profile)"
+    native.genrule(
+        name = name + "_c",
+        srcs = srcs,
+        outs = [name + ".c"],
+        cmd = "$(location //bf) --input $(location " + input + ".bf) " + flags + " > $@",
+        tools = ["//bf"],
+    )
+    native.cc_binary(
+        name = name,
+        srcs = [name + ".c"],
+        copts = ["-O3"],
+    )
+    native.sh_test(
+        name = "bf_aot_test__" + input + ("__pgo" if profile else ""),
+        srcs = ["bf_aot_test.sh"],
+        args = [name, input],
+        data = [
+            input + ".out",
+            name,
+        ],
         size = size,
     )